@@ -0,0 +1,1980 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "assembler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+OpcodeEntry opcode_table[] = {
+	{"add", 0}, {"sub", 1}, {"mul", 2},
+	{"and", 3}, {"or", 4}, {"xor", 5},
+	{"sll", 6}, {"sra", 7}, {"srl", 8},
+	{"beq", 9}, {"bne", 10}, {"blt", 11},
+	{"bgt", 12}, {"ble", 13}, {"bge", 14},
+	{"jal", 15}, {"lw", 16}, {"sw", 17},
+	{"reti", 18}, {"in", 19}, {"out", 20},
+	{"halt", 21},
+	{"li", PSEUDO_LI}, {"move", PSEUDO_MOVE}, {"b", PSEUDO_B},
+	{"call", PSEUDO_CALL}, {"ret", PSEUDO_RET}, {"push", PSEUDO_PUSH},
+	{"pop", PSEUDO_POP}
+};
+int opcode_table_size = sizeof(opcode_table) / sizeof(OpcodeEntry);
+
+RegisterEntry register_table[] = {
+	{"$zero", 0}, { "$imm", 1 }, { "$v0", 2 },
+	{ "$a0", 3 }, { "$a1", 4 }, { "$a2", 5 }, { "$a3", 6 },
+	{ "$t0", 7 }, { "$t1", 8 }, { "$t2", 9 },
+	{ "$s0", 10 }, { "$s1", 11 }, { "$s2", 12 },
+	{ "$gp", 13 }, { "$sp", 14 }, { "$ra", 15 }
+};
+int register_table_size = sizeof(register_table) / sizeof(RegisterEntry);
+
+// Perfect hash of the opcode table (index in opcode_table, -1 = empty)
+const signed char opcode_slots[OPCODE_HASH_SIZE] = {
+	-1, -1, -1, 5, -1, -1, -1, 14, 18, 13, -1, -1, -1, 9, -1, 27,
+	2, 3, 26, -1, 28, 1, -1, -1, 19, -1, 7, 0, -1, 24, -1, -1,
+	20, -1, -1, 4, 25, 6, -1, -1, 21, -1, 22, -1, -1, -1, 11, -1,
+	-1, 17, -1, -1, 16, -1, -1, -1, 10, 12, -1, -1, -1, 8, 15, 23
+};
+
+// Perfect hash of the register table (index in register_table, -1 = empty)
+const signed char register_slots[REGISTER_HASH_SIZE] = {
+	0, -1, 1, -1, 3, -1, 15, -1, -1, -1, 8, -1, 14, 10, 5, -1,
+	-1, -1, -1, 2, -1, 13, 12, 9, -1, 7, -1, 4, -1, 6, 11, -1
+};
+
+// Character class of every byte for the lexer: CHAR_END, CHAR_COMMENT, CHAR_SPACE, CHAR_COMMA,
+// CHAR_COLON, CHAR_WORD (letters, digits, '_', '.' and '$') or CHAR_OTHER
+const unsigned char char_class[256] = {
+	0, 6, 6, 6, 6, 6, 6, 6, 6, 2, 0, 2, 2, 2, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	2, 6, 6, 1, 5, 6, 6, 6, 6, 6, 6, 6, 3, 6, 5, 6,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 4, 6, 6, 6, 6, 6,
+	6, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 5,
+	6, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+	6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6
+};
+
+// Reads the whole file into a null terminated buffer
+char* read_source(const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	// Get the size of the file
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	char* buffer = malloc((size_t)size + 1);
+	if (buffer == NULL) {
+		fclose(file);
+		return NULL;
+	}
+	size_t read = fread(buffer, 1, (size_t)size, file);
+	buffer[read] = '\0';
+
+	fclose(file);
+	return buffer;
+}
+
+// Makes room for one more element in a growable array, doubling its capacity when full
+void* grow_array(void* array, int* capacity, int count, size_t element_size) {
+	if (count < *capacity) {
+		return array;
+	}
+	int new_capacity = *capacity ? *capacity * 2 : 64;
+	void* new_array = realloc(array, (size_t)new_capacity * element_size);
+	if (new_array == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	*capacity = new_capacity;
+	return new_array;
+}
+
+// Removes comments from a given line
+void remove_comments(char* line) {
+	char* comment = strchr(line, '#');
+	if (comment) {
+		*comment = '\0'; // Terminate the string at the comment position
+	}
+}
+
+// Parse numbers, end is set to the first char after the number
+int parse_number(const char* token, const char** end) {
+	char* number_end;
+	int result;
+
+	// Check if the token starts with 0x or 0X
+	if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+		// Parse as hexadecimal
+		result = (int)strtoul(token, &number_end, 16);
+	}
+	else {
+		// Try to parse with base 0
+		result = (int)strtol(token, &number_end, 0);
+	}
+	*end = number_end;
+	return result;
+}
+
+// Copies length chars of the text to a new null terminated string
+char* copy_string(const char* text, size_t length) {
+	char* copy = malloc(length + 1);
+	if (copy == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+// Terminates the line and returns the start of the next line
+char* next_line(char* line) {
+	char* next = strchr(line, '\n');
+	if (next) {
+		*next = '\0';
+		return next + 1;
+	}
+	return line + strlen(line);
+}
+
+// Returns the next operand and moves the cursor after it. Operands are separated by spaces or commas
+char* take_token(char** cursor) {
+	char* token = *cursor;
+	while (*token == ' ' || *token == '\t' || *token == '\r' || *token == ',') { token++; }
+	if (*token == '\0') {
+		*cursor = token;
+		return NULL;
+	}
+	char* end = token + strcspn(token, " \t\r,");
+	*cursor = *end ? end + 1 : end;
+	*end = '\0';
+	return token;
+}
+
+// Returns the rest of the line as one operand, so it can hold an expression with spaces
+char* take_rest(char** cursor) {
+	char* token = *cursor;
+	while (*token == ' ' || *token == '\t' || *token == '\r' || *token == ',') { token++; }
+	char* end = token + strlen(token);
+	while (end > token && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) { end--; }
+	*end = '\0';
+	*cursor = end;
+	return *token ? token : NULL;
+}
+
+// Skips spaces, and commas too if commas is set
+char* skip_spaces(char* c, int commas) {
+	while (char_class[(unsigned char)*c] == CHAR_SPACE || (commas && char_class[(unsigned char)*c] == CHAR_COMMA)) { c++; }
+	return c;
+}
+
+// Scans a token up to a space, comma, colon, comment or the end of the line
+char* scan_token(char* c) {
+	while (char_class[(unsigned char)*c] >= CHAR_WORD) { c++; }
+	return c;
+}
+
+// Adds a token that starts at start and ends before end, and terminates it in place
+void add_token(Token tokens[], int* token_num, int type, int value, char* start, char* end, const char* line) {
+	Token* token = &tokens[(*token_num)++];
+	token->type = type;
+	token->value = value;
+	token->text = start;
+	token->column = (int)(start - line) + 1;
+	*end = '\0';
+}
+
+// Splits a line into typed tokens in one pass over a table of character classes. The line can start
+// with a label definition. Then comes a directive, a mnemonic or a macro name. The registers of a
+// mnemonic are single tokens, the rest of the line is one operand: a number, a label or an expression
+// that is parsed later. Directives and macros get the rest of the line as one text token.
+// The tokens are terminated in place and the comment is cut off. Returns the number of tokens
+int lex_line(char* line, Token tokens[], int max_tokens) {
+	int token_num = 0;
+	char* c = skip_spaces(line, 0);
+	char* start = c;
+	char* end = scan_token(c);
+
+	if (end == start) {
+		*c = '\0';
+		return 0;
+	}
+
+	// Label definition
+	if (char_class[(unsigned char)*end] == CHAR_COLON) {
+		add_token(tokens, &token_num, TOKEN_LABEL, 0, start, end, line);
+		start = skip_spaces(end + 1, 0);
+		end = scan_token(start);
+		if (end == start) {
+			*start = '\0';
+			return token_num;
+		}
+	}
+
+	// Directive, mnemonic or macro name
+	int next_class = char_class[(unsigned char)*end];
+	c = end + (next_class != CHAR_END);
+	if (start[0] == '.') {
+		add_token(tokens, &token_num, TOKEN_DIRECTIVE, 0, start, end, line);
+	}
+	else {
+		add_token(tokens, &token_num, TOKEN_NAME, 0, start, end, line);
+		int code = start[0] == '$' ? -1 : lookup_word(start);
+		if (code >= 0) {
+			tokens[token_num - 1].type = TOKEN_MNEMONIC;
+			tokens[token_num - 1].value = code;
+		}
+	}
+	if (next_class == CHAR_COMMENT) {
+		return token_num;
+	}
+
+	// Registers of a mnemonic
+	c = skip_spaces(c, tokens[token_num - 1].type == TOKEN_MNEMONIC);
+	while (tokens[token_num - 1].type == TOKEN_MNEMONIC || tokens[token_num - 1].type == TOKEN_REGISTER) {
+		if (*c != '$' || token_num >= max_tokens - 1) {
+			break;
+		}
+		start = c;
+		end = scan_token(c);
+		next_class = char_class[(unsigned char)*end];
+		c = end + (next_class != CHAR_END);
+		add_token(tokens, &token_num, TOKEN_REGISTER, 0, start, end, line);
+		tokens[token_num - 1].value = lookup_word(start);
+		if (next_class == CHAR_COMMENT) {
+			return token_num;
+		}
+		c = skip_spaces(c, 1);
+	}
+
+	// The rest of the line up to the comment, without the spaces at the end
+	start = c;
+	while (char_class[(unsigned char)*c] > CHAR_COMMENT) { c++; }
+	end = c;
+	while (end > start && char_class[(unsigned char)end[-1]] == CHAR_SPACE) { end--; }
+	if (end == start || token_num >= max_tokens) {
+		*end = '\0';
+		return token_num;
+	}
+
+	int type = TOKEN_TEXT;
+	int value = 0;
+	if (tokens[token_num - 1].type == TOKEN_MNEMONIC || tokens[token_num - 1].type == TOKEN_REGISTER) {
+		// Plain numbers are read here, so they do not go through the expression parser
+		const char* digits = start + (*start == '-');
+		const char* number_end = digits;
+		if (*digits >= '0' && *digits <= '9') {
+			value = parse_number(digits, &number_end);
+		}
+		if (number_end == end && number_end != digits) {
+			type = TOKEN_NUMBER;
+			value = *start == '-' ? (int)(0u - (unsigned int)value) : value;
+		}
+		else if (scan_token(start) == end && !(*start >= '0' && *start <= '9') && *start != '$') {
+			type = TOKEN_LABEL;
+		}
+	}
+	add_token(tokens, &token_num, type, value, start, end, line);
+	return token_num;
+}
+
+// Goes over the source buffer once and splits it into instructions, labels and .word entries.
+// Returns the number of instructions or -1 on error
+int parse_source(AsmContext* context, char* source, const char* filename) {
+	Parser parser;
+	int line_number = 0;
+	char* line = source;
+
+	memset(&parser, 0, sizeof(Parser));
+	parser.context = context;
+	parser.symbols = &context->symbols;
+	parser.file = context_add_file(context, filename);
+	parser.defining = -1;
+	symbols_init(&parser.macro_names);
+	context->word_entries_count = 0;
+
+	while (*line != '\0') {
+		char* next = next_line(line);
+		line_number++;
+		parse_line(&parser, line, line_number);
+		line = next;
+	}
+	if (parser.defining >= 0) {
+		printf("Error: Missing .endm for macro '%s'\n", symbols_name(&parser.macro_names, parser.defining));
+		parser.errors++;
+	}
+
+	// Free the macros
+	for (int i = 0; i < parser.macro_names.label_num; i++) {
+		for (int j = 0; j < parser.macros[i].param_num; j++) {
+			free(parser.macros[i].params[j]);
+		}
+		free(parser.macros[i].body);
+	}
+	free(parser.macros);
+	symbols_free(&parser.macro_names);
+
+	return parser.errors ? -1 : context->line_num;
+}
+
+// Parses one line of the source: label, directive, instruction or macro line
+void parse_line(Parser* parser, char* line, int line_number) {
+	Token tokens[MAX_TOKENS + 2];
+
+	// Lines of a macro definition are kept as text until .endm
+	if (parser->defining >= 0) {
+		remove_comments(line);
+		line = skip_spaces(line, 0);
+		if (strncmp(line, ".endm", 5) == 0) {
+			parser->defining = -1;
+		}
+		else {
+			Macro* macro = &parser->macros[parser->defining];
+			append_text(macro, line, strlen(line));
+			append_text(macro, "\n", 1);
+		}
+		return;
+	}
+
+	int token_num = lex_line(line, tokens, MAX_TOKENS + 2);
+	int first = 0;
+
+	// Label points to the next instruction
+	if (token_num > 0 && tokens[0].type == TOKEN_LABEL) {
+		int index = symbols_intern(parser->symbols, tokens[0].text);
+		if (parser->symbols->labels[index].defined) {
+			printf("Error: Label '%s' defined twice at line %d\n", tokens[0].text, line_number);
+			parser->errors++;
+		}
+		parser->symbols->labels[index].defined = 1;
+		parser->symbols->labels[index].line_index = parser->context->line_num;
+		first = 1;
+	}
+
+	// If line is empty after removing spaces, labels and comments, skip it
+	if (first == token_num) {
+		return;
+	}
+
+	if (tokens[first].type != TOKEN_DIRECTIVE) {
+		if (parse_instruction(parser, tokens + first, token_num - first, line_number) != 0) {
+			parser->errors++;
+		}
+		return;
+	}
+
+	// Directives get the rest of the line
+	const char* name = tokens[first].text;
+	char* text = first + 1 < token_num ? tokens[first + 1].text : "";
+	if (strcmp(name, ".word") == 0) {
+		parse_word_entry(parser, text, line_number);
+	}
+	else if (strcmp(name, ".equ") == 0) {
+		parse_equ(parser, text, line_number);
+	}
+	else if (strcmp(name, ".global") == 0) {
+		parse_global(parser, text, line_number);
+	}
+	else if (strcmp(name, ".loop") == 0) {
+		parse_loop(parser, text, line_number);
+	}
+	else if (strcmp(name, ".macro") == 0) {
+		define_macro(parser, text, line_number);
+	}
+	else if (strcmp(name, ".endm") == 0) {
+		printf("Error: .endm without .macro at line %d\n", line_number);
+		parser->errors++;
+	}
+	else {
+		printf("Error: Unknown directive '%s' at line %d\n", name, line_number);
+		parser->errors++;
+	}
+}
+
+// Adds the instructions of a lexed line: a mnemonic with its registers and immediate, or a macro invocation
+int parse_instruction(Parser* parser, Token tokens[], int token_num, int line_number) {
+	char* args[MAX_TOKENS];
+	int values[4] = { 0 };
+	int arg_num = 0;
+	const char* name = tokens[0].text;
+
+	if (tokens[0].type != TOKEN_MNEMONIC) {
+		// Not an opcode, check for a macro. Macro arguments are separated by commas
+		int macro = symbols_find(&parser->macro_names, name);
+		if (macro < 0) {
+			printf("Error: Unknown opcode '%s' at line %d\n", name, line_number);
+			return -1;
+		}
+		char* cursor = token_num > 1 ? tokens[1].text : "";
+		while (*cursor != '\0' && arg_num < MAX_TOKENS) {
+			char* comma = strchr(cursor, ',');
+			char* next = comma ? comma + 1 : cursor + strlen(cursor);
+			if (comma) { *comma = '\0'; }
+			char* arg = take_rest(&cursor);
+			args[arg_num++] = arg ? arg : "";
+			cursor = next;
+		}
+		return expand_macro(parser, macro, args, arg_num, line_number);
+	}
+
+	int code = tokens[0].value;
+	if (code >= PSEUDO_BASE) {
+		for (int i = 1; i < token_num && arg_num < MAX_TOKENS; i++) {
+			args[arg_num++] = tokens[i].text;
+		}
+		return expand_pseudo(parser, code, args, arg_num, line_number);
+	}
+
+	// Real instruction: opcode, rd, rs, rt and immediate. Missing operands are zero
+	values[0] = code;
+	int reg = 1;
+	for (; reg < token_num && tokens[reg].type == TOKEN_REGISTER; reg++) {
+		if (reg > 3) {
+			printf("Error: Too many registers at line %d, column %d\n", line_number, tokens[reg].column);
+			return -1;
+		}
+		if (tokens[reg].value < 0) {
+			printf("Error: Unknown register '%s' at line %d\n", tokens[reg].text, line_number);
+			return -1;
+		}
+		values[reg] = tokens[reg].value;
+	}
+	if (reg == token_num) {
+		return add_instruction(parser, values[0], values[1], values[2], values[3], NULL, 0, line_number);
+	}
+	if (reg < 4) {
+		printf("Error: Unknown register '%s' at line %d\n", tokens[reg].text, line_number);
+		return -1;
+	}
+	if (tokens[reg].type == TOKEN_NUMBER) {
+		return add_instruction(parser, values[0], values[1], values[2], values[3], NULL, tokens[reg].value, line_number);
+	}
+	return add_instruction(parser, values[0], values[1], values[2], values[3], tokens[reg].text, 0, line_number);
+}
+
+// Returns the number of the register or -1 if the token is not a register
+int parse_register(const char* token, int line_number) {
+	int reg = token[0] == '$' ? lookup_word(token) : -1;
+	if (reg < 0) {
+		printf("Error: Unknown register '%s' at line %d\n", token, line_number);
+	}
+	return reg;
+}
+
+// Adds an instruction. The immediate is the given label or number token, or value if there is no token
+int add_instruction(Parser* parser, int opcode, int rd, int rs, int rt, const char* immediate, int value, int line_number) {
+	parser->context->lines = grow_array(parser->context->lines, &parser->context->line_capacity, parser->context->line_num, sizeof(Instruction));
+	Instruction* instruction = &parser->context->lines[parser->context->line_num++];
+
+	strcpy(instruction->opcode_str, opcode_table[opcode].OpCodeName);
+	instruction->opcode = opcode;
+	instruction->rd = rd;
+	instruction->rs = rs;
+	instruction->rt = rt;
+	instruction->immediate = value;
+	instruction->has_label = 0;
+	instruction->is_bigimm = 0;
+	instruction->line_number = line_number;
+	instruction->file = parser->file;
+	instruction->label = -1;
+	instruction->expr = -1;
+	instruction->address = 0;
+
+	if (immediate != NULL) {
+		if (parse_expression(parser, immediate, line_number, &instruction->immediate, &instruction->expr, &instruction->label) != 0) {
+			parser->context->line_num--;
+			return -1;
+		}
+		instruction->has_label = instruction->label >= 0 || instruction->expr >= 0;
+	}
+	return 0;
+}
+
+// Adds the real instructions of a pseudo instruction
+int expand_pseudo(Parser* parser, int code, char* args[], int arg_num, int line_number) {
+	static const int arg_nums[] = { 2, 2, 1, 1, 0, -1, -1 };  // -1 = one or more registers
+	int regs[MAX_TOKENS];
+	int expected = arg_nums[code - PSEUDO_BASE];
+
+	if ((expected >= 0 && arg_num != expected) || (expected < 0 && arg_num < 1)) {
+		printf("Error: Wrong number of operands at line %d\n", line_number);
+		return -1;
+	}
+	for (int i = 0; i < arg_num; i++) {
+		// li and the jumps take a label or number as the last operand
+		if ((code == PSEUDO_LI && i == 1) || code == PSEUDO_B || code == PSEUDO_CALL) {
+			continue;
+		}
+		regs[i] = parse_register(args[i], line_number);
+		if (regs[i] < 0) {
+			return -1;
+		}
+	}
+
+	switch (code) {
+	case PSEUDO_LI:
+		return add_instruction(parser, OP_ADD, regs[0], REG_ZERO, REG_IMM, args[1], 0, line_number);
+	case PSEUDO_MOVE:
+		return add_instruction(parser, OP_ADD, regs[0], regs[1], REG_ZERO, NULL, 0, line_number);
+	case PSEUDO_B:
+		return add_instruction(parser, OP_BEQ, REG_IMM, REG_ZERO, REG_ZERO, args[0], 0, line_number);
+	case PSEUDO_CALL:
+		return add_instruction(parser, OP_JAL, REG_RA, REG_IMM, REG_ZERO, args[0], 0, line_number);
+	case PSEUDO_RET:
+		return add_instruction(parser, OP_BEQ, REG_RA, REG_ZERO, REG_ZERO, NULL, 0, line_number);
+	case PSEUDO_PUSH:
+		// One stack pointer update for all the registers, the first register is pushed first
+		add_instruction(parser, OP_SUB, REG_SP, REG_SP, REG_IMM, NULL, arg_num, line_number);
+		for (int i = 0; i < arg_num; i++) {
+			int offset = arg_num - 1 - i;
+			add_instruction(parser, OP_SW, regs[i], REG_SP, offset ? REG_IMM : REG_ZERO, NULL, offset, line_number);
+		}
+		return 0;
+	case PSEUDO_POP:
+		// The first register is popped first
+		for (int i = 0; i < arg_num; i++) {
+			add_instruction(parser, OP_LW, regs[i], REG_SP, i ? REG_IMM : REG_ZERO, NULL, i, line_number);
+		}
+		return add_instruction(parser, OP_ADD, REG_SP, REG_SP, REG_IMM, NULL, arg_num, line_number);
+	}
+	return -1;
+}
+
+// Starts a macro definition: .macro name param1, param2, ...
+void define_macro(Parser* parser, char* text, int line_number) {
+	char* cursor = text;
+	char* name = take_token(&cursor);
+	if (name == NULL) {
+		printf("Error: Missing macro name at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+	if (lookup_word(name) >= 0 || symbols_find(&parser->macro_names, name) >= 0) {
+		printf("Error: Macro name '%s' is already used at line %d\n", name, line_number);
+		parser->errors++;
+		return;
+	}
+
+	int index = symbols_intern(&parser->macro_names, name);
+	parser->macros = grow_array(parser->macros, &parser->macro_capacity, index, sizeof(Macro));
+	Macro* macro = &parser->macros[index];
+	memset(macro, 0, sizeof(Macro));
+
+	for (char* param = take_token(&cursor); param != NULL; param = take_token(&cursor)) {
+		if (macro->param_num >= MACRO_MAX_PARAMS) {
+			printf("Error: Too many macro parameters at line %d\n", line_number);
+			parser->errors++;
+			break;
+		}
+		macro->params[macro->param_num++] = copy_string(param, strlen(param));
+	}
+	parser->defining = index;
+}
+
+// Appends text to the body of a macro
+void append_text(Macro* macro, const char* text, size_t length) {
+	if (macro->body_size + (int)length + 1 > macro->body_capacity) {
+		int capacity = macro->body_capacity ? macro->body_capacity : 256;
+		while (macro->body_size + (int)length + 1 > capacity) { capacity *= 2; }
+		char* body = realloc(macro->body, (size_t)capacity);
+		if (body == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+		macro->body = body;
+		macro->body_capacity = capacity;
+	}
+	memcpy(macro->body + macro->body_size, text, length);
+	macro->body_size += (int)length;
+	macro->body[macro->body_size] = '\0';
+}
+
+// Replaces \param with the arguments and \@ with a number unique to this expansion, then parses the lines
+int expand_macro(Parser* parser, int index, char* args[], int arg_num, int line_number) {
+	Macro* macro = &parser->macros[index];
+	Macro expansion;
+	char number[16];
+
+	if (arg_num != macro->param_num) {
+		printf("Error: Macro '%s' expects %d arguments at line %d\n", symbols_name(&parser->macro_names, index), macro->param_num, line_number);
+		return -1;
+	}
+	if (parser->depth >= MACRO_MAX_DEPTH) {
+		printf("Error: Macro expansion too deep at line %d\n", line_number);
+		return -1;
+	}
+
+	memset(&expansion, 0, sizeof(Macro));
+	append_text(&expansion, "", 0);
+	sprintf(number, "%d", parser->expansions++);
+
+	for (const char* c = macro->body; c != NULL && *c != '\0'; c++) {
+		if (*c != '\\') {
+			append_text(&expansion, c, 1);
+			continue;
+		}
+		if (c[1] == '@') {
+			append_text(&expansion, number, strlen(number));
+			c++;
+			continue;
+		}
+		// Find the parameter name
+		size_t length = 0;
+		while (isalnum((unsigned char)c[1 + length]) || c[1 + length] == '_') { length++; }
+		int param = -1;
+		for (int i = 0; i < macro->param_num; i++) {
+			if (strlen(macro->params[i]) == length && strncmp(macro->params[i], c + 1, length) == 0) {
+				param = i;
+			}
+		}
+		if (param < 0) {
+			printf("Error: Unknown macro parameter '\\%.*s' at line %d\n", (int)length, c + 1, line_number);
+			free(expansion.body);
+			return -1;
+		}
+		append_text(&expansion, args[param], strlen(args[param]));
+		c += length;
+	}
+
+	// Parse the expanded lines, errors are counted by parse_line
+	parser->depth++;
+	for (char* line = expansion.body; *line != '\0';) {
+		char* next = next_line(line);
+		parse_line(parser, line, line_number);
+		line = next;
+	}
+	parser->depth--;
+	free(expansion.body);
+	return 0;
+}
+
+// Parses the address and data of a .word line and adds it to the .word entries
+void parse_word_entry(Parser* parser, char* text, int line_number) {
+	AsmContext* context = parser->context;
+	char* cursor = text;
+	char* address_str = take_token(&cursor);
+	char* data_str = take_rest(&cursor);
+	int address;
+	int data;
+	int expr;
+
+	if (address_str == NULL || data_str == NULL) {
+		printf("Warning: Invalid .word at line %d\n", line_number);
+		return;
+	}
+	if (parse_expression(parser, address_str, line_number, &address, &expr, NULL) != 0) {
+		parser->errors++;
+		return;
+	}
+	if (expr >= 0) {
+		printf("Error: .word address must be a constant at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+	// Words past MEMORY_SIZE need a simulator run with -addrbits
+	if (address < 0 || address >= MAX_MEMORY_SIZE) {
+		printf("Error: .word address out of memory at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+	if (parse_expression(parser, data_str, line_number, &data, &expr, NULL) != 0) {
+		parser->errors++;
+		return;
+	}
+
+	context->word_entries = grow_array(context->word_entries, &context->word_entries_capacity, context->word_entries_count, sizeof(WordEntry));
+	context->word_entries[context->word_entries_count].address = address;
+	context->word_entries[context->word_entries_count].data = data;
+	context->word_entries[context->word_entries_count].expr = expr;
+	context->word_entries[context->word_entries_count].line_number = line_number;
+	context->word_entries[context->word_entries_count].file = parser->file;
+	context->word_entries_count++;
+}
+
+// Defines a constant: .equ name expression
+void parse_equ(Parser* parser, char* text, int line_number) {
+	char* cursor = text;
+	char* name = take_token(&cursor);
+	char* value_str = take_rest(&cursor);
+	int value;
+	int expr;
+
+	if (name == NULL || value_str == NULL) {
+		printf("Error: Invalid .equ at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+	if (parse_expression(parser, value_str, line_number, &value, &expr, NULL) != 0) {
+		parser->errors++;
+		return;
+	}
+	if (expr >= 0) {
+		printf("Error: .equ value must not use labels at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+
+	int index = symbols_intern(parser->symbols, name);
+	if (parser->symbols->labels[index].defined) {
+		printf("Error: Label '%s' defined twice at line %d\n", name, line_number);
+		parser->errors++;
+		return;
+	}
+	parser->symbols->labels[index].defined = 1;
+	parser->symbols->labels[index].constant = 1;
+	parser->symbols->labels[index].position = value;
+}
+
+// Exports labels and constants from the module: .global name, ...
+void parse_global(Parser* parser, char* text, int line_number) {
+	char* cursor = text;
+	char* name = take_token(&cursor);
+
+	if (name == NULL) {
+		printf("Error: Invalid .global at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+	for (; name != NULL; name = take_token(&cursor)) {
+		int index = symbols_intern(parser->symbols, name);
+		parser->symbols->labels[index].global = 1;
+	}
+}
+
+// Annotates the loop that starts at the next instruction with its bound: .loop N.
+// N is the max number of times the loop header runs each time the loop is entered.
+// The annotation does not change the code, it is used by the timing analyzer
+void parse_loop(Parser* parser, char* text, int line_number) {
+	AsmContext* context = parser->context;
+	int value;
+	int expr;
+
+	while (*text == ' ' || *text == '\t') { text++; }
+	if (parse_expression(parser, text, line_number, &value, &expr, NULL) != 0) {
+		parser->errors++;
+		return;
+	}
+	if (expr >= 0 || value <= 0) {
+		printf("Error: .loop bound must be a positive constant at line %d\n", line_number);
+		parser->errors++;
+		return;
+	}
+
+	context->loop_bounds = grow_array(context->loop_bounds, &context->loop_bound_capacity, context->loop_bound_count, sizeof(LoopBound));
+	LoopBound* loop = &context->loop_bounds[context->loop_bound_count++];
+	loop->line_index = context->line_num;
+	loop->bound = value;
+	loop->line_number = line_number;
+}
+
+// Parses an immediate expression. Numbers, labels and .equ constants can be combined with
+// + - * / % << >> & | ^ ~ and parentheses. An expression without labels is evaluated to value,
+// a single label is returned in label (if label is not NULL) and other expressions that use labels
+// are stored for evaluation after the labels get their address and returned in expr.
+// Returns 0 on success
+int parse_expression(Parser* parser, const char* text, int line_number, int* value, int* expr, int* label) {
+	AsmContext* context = parser->context;
+	ExprParser ep;
+	int start = context->expr_token_count;
+
+	ep.text = text;
+	ep.parser = parser;
+	ep.symbols = 0;
+	ep.error = 0;
+
+	compile_expression(&ep, 1);
+	while (*ep.text == ' ' || *ep.text == '\t') { ep.text++; }
+	if (ep.error || *ep.text != '\0') {
+		printf("Error: Invalid expression '%s' at line %d\n", text, line_number);
+		context->expr_token_count = start;
+		return -1;
+	}
+	add_expr_token(context, EXPR_END, 0);
+
+	*value = 0;
+	*expr = -1;
+	if (label != NULL) {
+		*label = -1;
+	}
+
+	if (ep.symbols == 0) {
+		// Constant expression
+		*value = evaluate_expression(context, start);
+		context->expr_token_count = start;
+	}
+	else if (label != NULL && context->expr_token_count - start == 2 && context->expr_tokens[start].type == EXPR_SYMBOL) {
+		// Plain label
+		*label = context->expr_tokens[start].value;
+		context->expr_token_count = start;
+	}
+	else {
+		*expr = start;
+	}
+	return 0;
+}
+
+// Adds a token to the expression tokens
+void add_expr_token(AsmContext* context, int type, int value) {
+	context->expr_tokens = grow_array(context->expr_tokens, &context->expr_token_capacity, context->expr_token_count, sizeof(ExprToken));
+	context->expr_tokens[context->expr_token_count].type = type;
+	context->expr_tokens[context->expr_token_count].value = value;
+	context->expr_token_count++;
+}
+
+// Returns the precedence of the binary operator at the start of the text, 0 if there is none
+int operator_precedence(const char* text, int* op, int* length) {
+	*length = 1;
+	*op = text[0];
+	switch (text[0]) {
+	case '|': return 1;
+	case '^': return 2;
+	case '&': return 3;
+	case '<':
+	case '>':
+		if (text[1] != text[0]) { return 0; }
+		*length = 2;
+		*op = text[0] == '<' ? EXPR_SHL : EXPR_SHR;
+		return 4;
+	case '+':
+	case '-': return 5;
+	case '*':
+	case '/':
+	case '%': return 6;
+	default: return 0;
+	}
+}
+
+// Compiles binary operators with at least the given precedence to reverse polish notation
+void compile_expression(ExprParser* ep, int min_precedence) {
+	int op;
+	int length;
+
+	compile_operand(ep);
+	while (!ep->error) {
+		while (*ep->text == ' ' || *ep->text == '\t') { ep->text++; }
+		int precedence = operator_precedence(ep->text, &op, &length);
+		if (precedence == 0 || precedence < min_precedence) {
+			return;
+		}
+		ep->text += length;
+		compile_expression(ep, precedence + 1);
+		add_expr_token(ep->parser->context, op, 0);
+	}
+}
+
+// Compiles a number, label, unary operator or expression in parentheses
+void compile_operand(ExprParser* ep) {
+	while (*ep->text == ' ' || *ep->text == '\t') { ep->text++; }
+	char c = *ep->text;
+
+	if (c == '-' || c == '~' || c == '+') {
+		ep->text++;
+		compile_operand(ep);
+		if (c != '+') {
+			add_expr_token(ep->parser->context, c == '-' ? EXPR_NEG : '~', 0);
+		}
+	}
+	else if (c == '(') {
+		ep->text++;
+		compile_expression(ep, 1);
+		while (*ep->text == ' ' || *ep->text == '\t') { ep->text++; }
+		if (*ep->text != ')') {
+			ep->error = 1;
+			return;
+		}
+		ep->text++;
+	}
+	else if (isdigit((unsigned char)c)) {
+		add_expr_token(ep->parser->context, EXPR_NUMBER, parse_number(ep->text, &ep->text));
+	}
+	else if (isalpha((unsigned char)c) || c == '_' || c == '.') {
+		// Label or .equ constant
+		size_t length = 0;
+		while (isalnum((unsigned char)ep->text[length]) || ep->text[length] == '_' || ep->text[length] == '.') { length++; }
+		char* name = copy_string(ep->text, length);
+		int index = symbols_intern(ep->parser->symbols, name);
+		free(name);
+		ep->text += length;
+
+		// Constants that are already defined are used as numbers
+		const Lable* symbol = &ep->parser->symbols->labels[index];
+		if (symbol->defined && symbol->constant) {
+			add_expr_token(ep->parser->context, EXPR_NUMBER, symbol->position);
+		}
+		else {
+			add_expr_token(ep->parser->context, EXPR_SYMBOL, index);
+			ep->symbols++;
+		}
+	}
+	else {
+		ep->error = 1;
+	}
+}
+
+// Evaluates an expression with the current label positions
+int evaluate_expression(const AsmContext* context, int expr) {
+	const SymbolTable* symbols = &context->symbols;
+	int stack[EXPR_MAX_DEPTH];
+	int depth = 0;
+
+	for (const ExprToken* token = &context->expr_tokens[expr]; token->type != EXPR_END; token++) {
+		if (token->type == EXPR_NUMBER || token->type == EXPR_SYMBOL) {
+			if (depth >= EXPR_MAX_DEPTH) {
+				return 0;
+			}
+			stack[depth++] = token->type == EXPR_NUMBER ? token->value : symbols->labels[token->value].position;
+			continue;
+		}
+		if (token->type == EXPR_NEG || token->type == '~') {
+			stack[depth - 1] = token->type == EXPR_NEG ? -stack[depth - 1] : ~stack[depth - 1];
+			continue;
+		}
+
+		// Binary operator
+		int right = stack[--depth];
+		int left = stack[depth - 1];
+		int result = 0;
+		switch (token->type) {
+		case '+': result = left + right; break;
+		case '-': result = left - right; break;
+		case '*': result = left * right; break;
+		case '/': result = right ? left / right : 0; break;
+		case '%': result = right ? left % right : 0; break;
+		case EXPR_SHL: result = (int)((unsigned int)left << (right & 31)); break;
+		case EXPR_SHR: result = left >> (right & 31); break;
+		case '&': result = left & right; break;
+		case '|': result = left | right; break;
+		case '^': result = left ^ right; break;
+		}
+		stack[depth - 1] = result;
+	}
+	return depth > 0 ? stack[0] : 0;
+}
+
+// Returns the value of the immediate with the current label positions
+int resolve_immediate(const AsmContext* context, const Instruction* instruction) {
+	const SymbolTable* symbols = &context->symbols;
+	if (instruction->expr >= 0) {
+		return evaluate_expression(context, instruction->expr);
+	}
+	if (instruction->label >= 0) {
+		return symbols->labels[instruction->label].position;
+	}
+	return instruction->immediate;
+}
+
+// Reports labels that are used but never defined. Returns the number of errors
+int check_symbols(const AsmContext* context) {
+	const Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	const SymbolTable* symbols = &context->symbols;
+	int errors = 0;
+	for (int i = 0; i < line_num; i++) {
+		if (lines[i].label >= 0 && !symbols->labels[lines[i].label].defined) {
+			printf("Error: Unknown label '%s' at line %d\n", symbols_name(symbols, lines[i].label), lines[i].line_number);
+			errors++;
+		}
+		for (int j = lines[i].expr; j >= 0 && context->expr_tokens[j].type != EXPR_END; j++) {
+			if (context->expr_tokens[j].type == EXPR_SYMBOL && !symbols->labels[context->expr_tokens[j].value].defined) {
+				printf("Error: Unknown label '%s' at line %d\n", symbols_name(symbols, context->expr_tokens[j].value), lines[i].line_number);
+				errors++;
+			}
+		}
+	}
+	for (int i = 0; i < context->word_entries_count; i++) {
+		for (int j = context->word_entries[i].expr; j >= 0 && context->expr_tokens[j].type != EXPR_END; j++) {
+			if (context->expr_tokens[j].type == EXPR_SYMBOL && !symbols->labels[context->expr_tokens[j].value].defined) {
+				printf("Error: Unknown label '%s' at line %d\n", symbols_name(symbols, context->expr_tokens[j].value), context->word_entries[i].line_number);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+// Goes over the instructions, sets their size and updates the label positions.
+// Label immediates start as imm8 and are widened to bigimm only when the label address
+// does not fit in 8 bits. Widening moves the labels after it, so repeat until nothing changes.
+int Get_labels(AsmContext* context)
+{
+	Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	SymbolTable* symbols = &context->symbols;
+	int counter = 0;
+	int changed = 1;
+
+	// Out-of-range number needs bigimm, labels are decided below
+	for (int i = 0; i < line_num; i++) {
+		lines[i].is_bigimm = !lines[i].has_label && (lines[i].immediate < -128 || lines[i].immediate > 127);
+	}
+
+	while (changed) {
+		changed = 0;
+		counter = 0;
+		for (int i = 0; i < line_num; i++) {
+			lines[i].address = counter;
+			counter += lines[i].is_bigimm ? 2 : 1;
+		}
+
+		// Labels get the address of the instruction they point to, constants keep their value
+		for (int i = 0; i < symbols->label_num; i++) {
+			Lable* lb = &symbols->labels[i];
+			if (lb->constant) {
+				continue;
+			}
+			lb->position = lb->line_index < line_num ? lines[lb->line_index].address : counter;
+		}
+
+		// Addresses only grow, so a label that does not fit stays that way
+		for (int i = 0; i < line_num; i++) {
+			if (lines[i].has_label && !lines[i].is_bigimm) {
+				int position = resolve_immediate(context, &lines[i]);
+				if (position < -128 || position > 127) {
+					lines[i].is_bigimm = 1;
+					changed = 1;
+				}
+			}
+		}
+	}
+	return(counter);
+}
+
+// Returns the register written by the instruction or -1
+int writes_register(const Instruction* instruction) {
+	if (instruction->opcode <= OP_SRL || instruction->opcode == OP_JAL || instruction->opcode == OP_LW || instruction->opcode == OP_IN) {
+		return instruction->rd;
+	}
+	return -1;
+}
+
+// Checks if the instruction reads the register
+int reads_register(const Instruction* instruction, int reg) {
+	switch (instruction->opcode) {
+	case OP_JAL:
+		return instruction->rs == reg;
+	case OP_RETI:
+	case OP_HALT:
+		return 0;
+	default:
+		if (instruction->rs == reg || instruction->rt == reg) {
+			return 1;
+		}
+		// Branches, sw and out also read rd
+		return (instruction->opcode >= OP_BEQ && instruction->opcode <= OP_BGE) || instruction->opcode == OP_SW || instruction->opcode == OP_OUT
+			? instruction->rd == reg : 0;
+	}
+}
+
+// Checks if the instruction is an unconditional jump to its label
+int is_jump(const Instruction* instruction) {
+	return (instruction->opcode == OP_BEQ || instruction->opcode == OP_BLE || instruction->opcode == OP_BGE) &&
+		instruction->rd == REG_IMM && instruction->rs == instruction->rt && instruction->has_label;
+}
+
+// Checks if the label of the instruction is its jump target: a branch to $imm that does not compare $imm, or jal $imm
+int is_label_target(const Instruction* instruction) {
+	if (instruction->opcode >= OP_BEQ && instruction->opcode <= OP_BGE) {
+		return instruction->rd == REG_IMM && instruction->rs != REG_IMM && instruction->rt != REG_IMM;
+	}
+	return instruction->opcode == OP_JAL && instruction->rs == REG_IMM;
+}
+
+// Returns the first instruction from index that was not removed
+int next_kept(const char removed[], int line_num, int index) {
+	while (index < line_num && removed[index]) { index++; }
+	return index;
+}
+
+// Checks if the register is written before it is read after the instruction, without leaving the block
+int register_is_dead_after(const Instruction lines[], const char removed[], const char label_at[], int line_num, int index, int reg) {
+	for (int i = next_kept(removed, line_num, index + 1); i < line_num; i = next_kept(removed, line_num, i + 1)) {
+		if (label_at[i]) {
+			return 0;
+		}
+		if (reads_register(&lines[i], reg)) {
+			return 0;
+		}
+		if (lines[i].opcode == OP_HALT || writes_register(&lines[i]) == reg) {
+			return 1;
+		}
+		if (lines[i].opcode >= OP_BEQ && lines[i].opcode <= OP_RETI) {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+// Marks the code after a label that is used as a value as frozen, up to the next label
+void freeze_label(const SymbolTable* symbols, int label, const char* label_at, char* frozen, int line_num) {
+	const Lable* lb = &symbols->labels[label];
+	if (!lb->defined || lb->constant) {
+		return;
+	}
+	for (int j = lb->line_index; j < line_num && (j == lb->line_index || !label_at[j]); j++) {
+		frozen[j] = 1;
+	}
+}
+
+// Peephole optimizer. Removes instructions that do nothing, threads jumps and folds constants into their use.
+// Code after a label whose address is used as a value (not as a jump target) is left as is up to the next label,
+// so code that computes addresses from labels keeps working. Returns the new number of instructions
+int optimize_program(AsmContext* context) {
+	Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	SymbolTable* symbols = &context->symbols;
+	char* removed = calloc((size_t)line_num + 1, 1);
+	char* frozen = calloc((size_t)line_num + 1, 1);
+	char* label_at = calloc((size_t)line_num + 1, 1);
+	if (removed == NULL || frozen == NULL || label_at == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	// Mark instructions that are jumped to and labels that are used as values
+	for (int i = 0; i < symbols->label_num; i++) {
+		if (symbols->labels[i].defined && !symbols->labels[i].constant) {
+			label_at[symbols->labels[i].line_index] = 1;
+		}
+	}
+	for (int i = 0; i < line_num; i++) {
+		if (lines[i].label < 0) {
+			continue;
+		}
+		if (!is_label_target(&lines[i])) {
+			freeze_label(symbols, lines[i].label, label_at, frozen, line_num);
+		}
+	}
+
+	// Labels in expressions are always used as values
+	for (int i = 0; i < line_num; i++) {
+		for (int j = lines[i].expr; j >= 0 && context->expr_tokens[j].type != EXPR_END; j++) {
+			if (context->expr_tokens[j].type == EXPR_SYMBOL) {
+				freeze_label(symbols, context->expr_tokens[j].value, label_at, frozen, line_num);
+			}
+		}
+	}
+	for (int i = 0; i < context->word_entries_count; i++) {
+		for (int j = context->word_entries[i].expr; j >= 0 && context->expr_tokens[j].type != EXPR_END; j++) {
+			if (context->expr_tokens[j].type == EXPR_SYMBOL) {
+				freeze_label(symbols, context->expr_tokens[j].value, label_at, frozen, line_num);
+			}
+		}
+	}
+
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+		for (int i = next_kept(removed, line_num, 0); i < line_num; i = next_kept(removed, line_num, i + 1)) {
+			Instruction* line = &lines[i];
+			if (frozen[i]) {
+				continue;
+			}
+
+			// Thread branches and calls to jumps, only when the label is the jump target and not a value
+			if (line->label >= 0 && !symbols->labels[line->label].constant && is_label_target(line)) {
+				for (int hops = 0; hops < MAX_JUMP_THREADING; hops++) {
+					int target = next_kept(removed, line_num, symbols->labels[line->label].line_index);
+					if (target >= line_num || target == i || frozen[target] || !is_jump(&lines[target]) || lines[target].label < 0 ||
+						lines[target].label == line->label || symbols->labels[lines[target].label].constant) {
+						break;
+					}
+					line->label = lines[target].label;
+					changed = 1;
+				}
+			}
+
+			// Code after halt or a jump is unreachable up to the next label
+			if (line->opcode == OP_HALT || is_jump(line)) {
+				for (int j = next_kept(removed, line_num, i + 1); j < line_num && !label_at[j] && !frozen[j]; j = next_kept(removed, line_num, j + 1)) {
+					removed[j] = 1;
+					changed = 1;
+				}
+			}
+
+			// ALU instruction that writes $zero or $imm does nothing
+			if (line->opcode <= OP_SRL && (line->rd == REG_ZERO || line->rd == REG_IMM)) {
+				removed[i] = 1;
+				changed = 1;
+				continue;
+			}
+
+			// Branch to the next instruction does nothing
+			if (line->opcode >= OP_BEQ && line->opcode <= OP_BGE && line->rd == REG_IMM && line->label >= 0 &&
+				!symbols->labels[line->label].constant &&
+				next_kept(removed, line_num, symbols->labels[line->label].line_index) == next_kept(removed, line_num, i + 1)) {
+				removed[i] = 1;
+				changed = 1;
+				continue;
+			}
+
+			// add $x, $zero, $imm, K followed by an instruction that uses $x and does not use $imm:
+			// use $imm with K directly in the second instruction when $x is not needed after it. The second instruction
+			// may not be a branch, jal or reti, $x could be needed where it goes
+			int reg = line->rd;
+			int next = next_kept(removed, line_num, i + 1);
+			if (line->opcode == OP_ADD && line->rs == REG_ZERO && line->rt == REG_IMM && next < line_num &&
+				!label_at[next] && !frozen[next] && !reads_register(&lines[next], REG_IMM) && reads_register(&lines[next], reg) &&
+				!(lines[next].opcode >= OP_BEQ && lines[next].opcode <= OP_RETI) && (writes_register(&lines[next]) == reg || register_is_dead_after(lines, removed, label_at, line_num, next, reg))) {
+				Instruction* use = &lines[next];
+				if (use->rs == reg) { use->rs = REG_IMM; }
+				if (use->rt == reg) { use->rt = REG_IMM; }
+				if (use->rd == reg && writes_register(use) != reg) { use->rd = REG_IMM; }
+				use->immediate = line->immediate;
+				use->has_label = line->has_label;
+				use->label = line->label;
+				use->expr = line->expr;
+				removed[i] = 1;
+				changed = 1;
+			}
+		}
+	}
+
+	// Remove the instructions and move the labels to the next kept instruction
+	int* new_index = malloc(((size_t)line_num + 1) * sizeof(int));
+	if (new_index == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	int count = 0;
+	for (int i = 0; i < line_num; i++) {
+		new_index[i] = count;
+		if (!removed[i]) {
+			lines[count++] = lines[i];
+		}
+	}
+	new_index[line_num] = count;
+	for (int i = 0; i < symbols->label_num; i++) {
+		if (symbols->labels[i].defined) {
+			symbols->labels[i].line_index = new_index[symbols->labels[i].line_index];
+		}
+	}
+	for (int i = 0; i < context->loop_bound_count; i++) {
+		context->loop_bounds[i].line_index = new_index[context->loop_bounds[i].line_index];
+	}
+
+	free(new_index);
+	free(removed);
+	free(frozen);
+	free(label_at);
+	context->line_num = count;
+	return count;
+}
+
+// Orders .word entries by address, entries that appear later in the source come last
+int compare_word_entries(const void* a, const void* b) {
+	const WordEntry* first = (const WordEntry*)a;
+	const WordEntry* second = (const WordEntry*)b;
+	if (first->address != second->address) {
+		return first->address < second->address ? -1 : 1;
+	}
+	return first->line_number - second->line_number;
+}
+
+// Encodes the instructions and the .word entries into memory words. Finds labels in the immediate and
+// changes them for the address. The image is allocated here. Returns the number of words or -1 on error
+int encode_program(AsmContext* context, int** image) {
+	Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	int linesCounter = 0;
+	int code_size = line_num > 0 ? lines[line_num - 1].address + (lines[line_num - 1].is_bigimm ? 2 : 1) : 0;
+	int word_num = code_size;
+
+	// Evaluate .word data that uses labels
+	for (int j = 0; j < context->word_entries_count; j++) {
+		if (context->word_entries[j].expr >= 0) {
+			context->word_entries[j].data = evaluate_expression(context, context->word_entries[j].expr);
+		}
+		if (context->word_entries[j].address >= word_num) {
+			word_num = context->word_entries[j].address + 1;
+		}
+	}
+
+	int* code = calloc((size_t)word_num + 1, sizeof(int));
+	if (code == NULL) {
+		printf("Error: Out of memory\n");
+		return -1;
+	}
+
+	// Goes over the instructions
+	for (int i = 0; i < line_num; i++) {
+		if (lines[i].has_label) {
+			lines[i].immediate = resolve_immediate(context, &lines[i]);
+		}
+		linesCounter += line_to_hexa(&lines[i], code + linesCounter);
+	}
+
+	// Sort .word entries by address to handle them in order, the last entry of an address is kept
+	qsort(context->word_entries, (size_t)context->word_entries_count, sizeof(WordEntry), compare_word_entries);
+	for (int i = 0; i < context->word_entries_count; i++) {
+		// .word entries inside the code replace the code word
+		if (context->word_entries[i].address < code_size) {
+			printf("Warning: .word at line %d overwrites code at address %d\n", context->word_entries[i].line_number, context->word_entries[i].address);
+		}
+		code[context->word_entries[i].address] = context->word_entries[i].data;
+	}
+
+	*image = code;
+	return word_num;
+}
+
+// Second run of the assembler. Encodes the program and writes the memory image in the format
+int assembler_second_run(AsmContext* context, const char* filename, int format) {
+	int* code;
+	int word_num = encode_program(context, &code);
+	if (word_num < 0) {
+		return -1;
+	}
+
+	int result = write_image_file(filename, code, word_num, format);
+	free(code);
+	return result < 0 ? -1 : word_num;
+}
+
+// Reads a word of a paged image, a NULL page is all zeros
+int image_word(const int* const* pages, int page_words, int address) {
+	const int* page = pages[address / page_words];
+	return page ? page[address % page_words] : 0;
+}
+
+// Finds the next run of words from start: it begins and ends with a non zero word and has at most
+// IMAGE_MAX_GAP zero words in a row. Returns the first word of the run, or word_num if there is none
+int next_run(const int* const* pages, int page_words, int word_num, int start, int* end) {
+	while (start < word_num && image_word(pages, page_words, start) == 0) {
+		// A missing page is skipped at once
+		start = pages[start / page_words] ? start + 1 : (start / page_words + 1) * page_words;
+	}
+	if (start > word_num) {
+		start = word_num;
+	}
+	*end = start;
+	for (int i = start; i < word_num && i - *end <= IMAGE_MAX_GAP; i++) {
+		if (image_word(pages, page_words, i) != 0) {
+			*end = i + 1;
+		}
+	}
+	return start;
+}
+
+// Writes memory words to an image file. The dense format has every word up to word_num, gaps are zero.
+// The sparse formats have a header with the image size and the number of records, then one record
+// per run: its address, its length and its words
+int write_image_file(const char* filename, const int* words, int word_num, int format) {
+	return write_paged_image_file(filename, &words, word_num > 0 ? word_num : 1, word_num, format);
+}
+
+// Writes an image that is split into pages of page_words words, pages[i] is NULL for a page of zeros.
+// The file is the same as write_image_file of the words put together
+int write_paged_image_file(const char* filename, const int* const* pages, int page_words, int word_num, int format) {
+	FILE* file = fopen(filename, format == IMAGE_BINARY ? "wb" : "w");
+	int record_num = 0;
+	int end;
+
+	if (file == NULL) {
+		printf("Error: Could not open output file.\n");
+		return -1;
+	}
+	if (format == IMAGE_DENSE) {
+		for (int i = 0; i < word_num; i++) {
+			fprintf(file, "%08X\n", image_word(pages, page_words, i));
+		}
+		fclose(file);
+		return 0;
+	}
+
+	for (int i = next_run(pages, page_words, word_num, 0, &end); i < word_num; i = next_run(pages, page_words, word_num, end, &end)) {
+		record_num++;
+	}
+	if (format == IMAGE_BINARY) {
+		fwrite(IMAGE_BINARY_MAGIC, 1, 8, file);
+		write_u32(file, IMAGE_VERSION);
+		write_u32(file, (unsigned int)word_num);
+		write_u32(file, (unsigned int)record_num);
+	}
+	else {
+		fprintf(file, "%s %d %d %d\n", IMAGE_MAGIC, IMAGE_VERSION, word_num, record_num);
+	}
+	for (int i = next_run(pages, page_words, word_num, 0, &end); i < word_num; i = next_run(pages, page_words, word_num, end, &end)) {
+		if (format == IMAGE_BINARY) {
+			write_u32(file, (unsigned int)i);
+			write_u32(file, (unsigned int)(end - i));
+			for (int j = i; j < end; j++) {
+				write_u32(file, (unsigned int)image_word(pages, page_words, j));
+			}
+		}
+		else {
+			fprintf(file, "@%03X %d\n", i, end - i);
+			for (int j = i; j < end; j++) {
+				fprintf(file, "%08X\n", image_word(pages, page_words, j));
+			}
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+// Writes a little endian 32 bit number
+void write_u32(FILE* file, unsigned int value) {
+	unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF };
+	fwrite(bytes, 1, 4, file);
+}
+
+// Reads a little endian 32 bit number. Returns 0 on success
+int read_u32(FILE* file, unsigned int* value) {
+	unsigned char bytes[4];
+	if (fread(bytes, 1, 4, file) != 4) {
+		return -1;
+	}
+	*value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+	return 0;
+}
+
+// Reads an image file. The format is found from the first bytes: the sparse magic words, or hex words
+// of the dense format. Words past the capacity are ignored, the size is at most the capacity
+int read_image_file(const char* filename, int* words, int capacity) {
+	FILE* file = fopen(filename, "rb");
+	char magic[9] = { 0 };
+	int word_num = 0;
+
+	if (file == NULL) {
+		return -1;
+	}
+	memset(words, 0, (size_t)capacity * sizeof(int));
+
+	size_t length = fread(magic, 1, 8, file);
+	if (length == 8 && memcmp(magic, IMAGE_BINARY_MAGIC, 8) == 0) {
+		word_num = read_sparse_binary(file, words, capacity);
+	}
+	else if (length >= 7 && memcmp(magic, IMAGE_MAGIC, 7) == 0) {
+		word_num = read_sparse_text(file, words, capacity);
+	}
+	else {
+		// Dense: one word per line, lines that are not 8 characters are skipped
+		char line[9];
+		fseek(file, 0, SEEK_SET);
+		while (word_num < capacity && fgets(line, sizeof(line), file)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (strlen(line) != 8) continue;
+			words[word_num++] = (int)strtoll(line, NULL, 16);
+		}
+	}
+	fclose(file);
+
+	if (word_num < 0) {
+		printf("Error: Corrupt memory image '%s'.\n", filename);
+	}
+	return word_num < capacity ? word_num : capacity;
+}
+
+// Reads the records of a sparse text image, after the magic word. Returns the image size or -1
+int read_sparse_text(FILE* file, int* words, int capacity) {
+	char line[64];
+	int version, word_num, record_num;
+	int record = 0;
+
+	if (fgets(line, sizeof(line), file) == NULL || sscanf(line, "%d %d %d", &version, &word_num, &record_num) != 3 ||
+		version != IMAGE_VERSION || word_num < 0 || record_num < 0) {
+		return -1;
+	}
+	for (; record < record_num && fgets(line, sizeof(line), file); record++) {
+		int address, count;
+		if (sscanf(line, "@%x %d", &address, &count) != 2 || address < 0 || count < 0 || count > word_num - address) {
+			return -1;
+		}
+		for (int i = 0; i < count; i++) {
+			if (fgets(line, sizeof(line), file) == NULL) {
+				return -1;
+			}
+			if (address + i < capacity) {
+				words[address + i] = (int)strtoll(line, NULL, 16);
+			}
+		}
+	}
+	return record == record_num ? word_num : -1;
+}
+
+// Reads the records of a sparse binary image, after the magic bytes. Returns the image size or -1
+int read_sparse_binary(FILE* file, int* words, int capacity) {
+	unsigned int version, word_num, record_num;
+
+	if (read_u32(file, &version) != 0 || read_u32(file, &word_num) != 0 || read_u32(file, &record_num) != 0 ||
+		version != IMAGE_VERSION || word_num > 0x7FFFFFFF) {
+		return -1;
+	}
+	for (unsigned int record = 0; record < record_num; record++) {
+		unsigned int address, count, value;
+		if (read_u32(file, &address) != 0 || read_u32(file, &count) != 0 || address > word_num || count > word_num - address) {
+			return -1;
+		}
+		for (unsigned int i = 0; i < count; i++) {
+			if (read_u32(file, &value) != 0) {
+				return -1;
+			}
+			if (address + i < (unsigned int)capacity) {
+				words[address + i] = (int)value;
+			}
+		}
+	}
+	return (int)word_num;
+}
+
+// Assembles source text into memory words and collects the labels and constants
+int assemble_program(const char* source, int optimize, AssembledProgram* program) {
+	AsmContext context;
+	char* text = copy_string(source, strlen(source));
+
+	memset(program, 0, sizeof(AssembledProgram));
+
+	// Same steps as the asm program, without the files
+	context_init(&context);
+	int line_num = parse_source(&context, text, "<memory>");
+	free(text);
+	if (line_num >= 0 && check_symbols(&context) != 0) {
+		line_num = -1;
+	}
+	if (line_num >= 0) {
+		if (optimize) {
+			optimize_program(&context);
+		}
+		Get_labels(&context);
+		program->word_num = encode_program(&context, &program->words);
+	}
+	if (line_num < 0 || program->word_num < 0) {
+		context_free(&context);
+		program->word_num = 0;
+		return -1;
+	}
+
+	// Copy the defined symbols
+	const SymbolTable* symbols = &context.symbols;
+	program->symbols = malloc(((size_t)symbols->label_num + 1) * sizeof(AssembledSymbol));
+	program->names = malloc((size_t)symbols->names_size + 1);
+	if (program->symbols == NULL || program->names == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	memcpy(program->names, symbols->names, (size_t)symbols->names_size);
+	for (int i = 0; i < symbols->label_num; i++) {
+		if (symbols->labels[i].defined) {
+			program->symbols[program->symbol_num].name = program->names + symbols->labels[i].name;
+			program->symbols[program->symbol_num].value = symbols->labels[i].position;
+			program->symbol_num++;
+		}
+	}
+	context_free(&context);
+	return 0;
+}
+
+// Reads and assembles a source file
+int assemble_file(const char* filename, int optimize, AssembledProgram* program) {
+	char* source = read_source(filename);
+	if (source == NULL) {
+		printf("Error: Could not open input file.\n");
+		memset(program, 0, sizeof(AssembledProgram));
+		return -1;
+	}
+	int result = assemble_program(source, optimize, program);
+	free(source);
+	return result;
+}
+
+// Frees the memory of an assembled program
+void free_assembled_program(AssembledProgram* program) {
+	free(program->words);
+	free(program->symbols);
+	free(program->names);
+	memset(program, 0, sizeof(AssembledProgram));
+}
+
+// Assembles a source file to a memory image file, or to an object file if object is set. Returns 0 on success
+int assemble_source_file(const char* input, const char* output, int optimize, int object, int debug, int format) {
+	AsmContext context;
+	int result;
+
+	// Read the whole input file into memory
+	char* source = read_source(input);
+	if (source == NULL) {
+		printf("Error: Could not open input file '%s'.\n", input);
+		return -1;
+	}
+
+	// Lex the source once into the instruction array, labels and .word entries
+	context_init(&context);
+	result = parse_source(&context, source, input);
+	free(source);
+
+	// Labels that are not defined are imports in an object file
+	if (result >= 0 && !object && check_symbols(&context) != 0) {
+		result = -1;
+	}
+	if (result >= 0) {
+		if (object) {
+			result = write_object(&context, output);
+		}
+		else {
+			// The symbol map is written next to the memory image
+			char* map_filename = NULL;
+			if (debug) {
+				map_filename = malloc(strlen(output) + sizeof(".map"));
+				if (map_filename == NULL) {
+					printf("Error: Out of memory\n");
+					exit(1);
+				}
+				sprintf(map_filename, "%s.map", output);
+			}
+			result = write_memory_image(&context, optimize, output, map_filename, format);
+			free(map_filename);
+		}
+	}
+
+	context_free(&context);
+	return result < 0 ? -1 : 0;
+}
+
+// Lays out the program and writes the memory image in the format. Returns -1 on error
+int write_memory_image(AsmContext* context, int optimize, const char* filename, const char* map_filename, int format) {
+	// Peephole optimizer
+	if (optimize) {
+		optimize_program(context);
+	}
+
+	// First pass: Get label addresses
+	Get_labels(context);
+
+	// Second pass: Generate machine code
+	int result = assembler_second_run(context, filename, format);
+
+	if (result >= 0 && map_filename != NULL) {
+		result = write_map(context, map_filename);
+	}
+	return result;
+}
+
+// Orders labels by address for the symbol map
+int compare_map_labels(const void* a, const void* b) {
+	const Lable* first = *(const Lable* const*)a;
+	const Lable* second = *(const Lable* const*)b;
+	if (first->position != second->position) {
+		return first->position < second->position ? -1 : 1;
+	}
+	return first->name - second->name;
+}
+
+// Writes the symbol map of a laid out program: the address of every label, and the source file and line
+// of every memory word. Must be called after encode_program. Returns -1 on error
+int write_map(const AsmContext* context, const char* filename) {
+	const SymbolTable* symbols = &context->symbols;
+	int label_num = 0;
+	int word_num = 0;
+
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		printf("Error: Could not open map file.\n");
+		return -1;
+	}
+
+	// Labels sorted by address, constants are not addresses
+	const Lable** labels = malloc(((size_t)symbols->label_num + 1) * sizeof(Lable*));
+	if (labels == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	for (int i = 0; i < symbols->label_num; i++) {
+		if (symbols->labels[i].defined && !symbols->labels[i].constant) {
+			labels[label_num++] = &symbols->labels[i];
+		}
+	}
+	qsort(labels, (size_t)label_num, sizeof(Lable*), compare_map_labels);
+	for (int i = 0; i < context->line_num; i++) {
+		word_num += context->lines[i].is_bigimm ? 2 : 1;
+	}
+	word_num += context->word_entries_count;
+
+	// Header: file, label and line counts
+	fprintf(file, "%s %d %d %d %d\n", MAP_MAGIC, MAP_VERSION, context->file_num, label_num, word_num);
+
+	// F index name
+	for (int i = 0; i < context->file_num; i++) {
+		fprintf(file, "F %d %s\n", i, context->files[i]);
+	}
+	// S address name
+	for (int i = 0; i < label_num; i++) {
+		fprintf(file, "S %03X %s\n", labels[i]->position, symbols->names + labels[i]->name);
+	}
+	// L address file line - the second word of a bigimm instruction has the line of the instruction,
+	// .word entries come last so they replace the code they overwrite
+	for (int i = 0; i < context->line_num; i++) {
+		const Instruction* line = &context->lines[i];
+		for (int j = 0; j < (line->is_bigimm ? 2 : 1); j++) {
+			fprintf(file, "L %03X %d %d\n", line->address + j, line->file, line->line_number);
+		}
+	}
+	for (int i = 0; i < context->word_entries_count; i++) {
+		const WordEntry* entry = &context->word_entries[i];
+		fprintf(file, "L %03X %d %d\n", entry->address, entry->file, entry->line_number);
+	}
+
+	free(labels);
+	int result = ferror(file) ? -1 : 0;
+	fclose(file);
+	if (result != 0) {
+		printf("Error: Could not write map file.\n");
+	}
+	return result;
+}
+
+// Writes the module as an object file for simp-ld. The instructions are kept before layout with their
+// labels and expressions, so the linker decides the instruction sizes once all the addresses are known.
+// Labels that are not defined in the module are imports. Returns -1 on error
+int write_object(const AsmContext* context, const char* filename) {
+	const Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	const SymbolTable* symbols = &context->symbols;
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		printf("Error: Could not open output file.\n");
+		return -1;
+	}
+
+	// Header: symbol, instruction, expression token, .word and source file counts
+	fprintf(file, "%s %d %d %d %d %d %d\n", OBJECT_MAGIC, OBJECT_VERSION, symbols->label_num, line_num, context->expr_token_count, context->word_entries_count, context->file_num);
+
+	// F index name - source files
+	for (int i = 0; i < context->file_num; i++) {
+		fprintf(file, "F %d %s\n", i, context->files[i]);
+	}
+
+	// S kind global value name - kind is L (label, value = instruction index), C (constant) or U (import)
+	for (int i = 0; i < symbols->label_num; i++) {
+		const Lable* lb = &symbols->labels[i];
+		char kind = !lb->defined ? 'U' : (lb->constant ? 'C' : 'L');
+		fprintf(file, "S %c %d %d %s\n", kind, lb->global, lb->constant ? lb->position : lb->line_index, symbols_name(symbols, i));
+	}
+	// I opcode rd rs rt immediate label expr line_number file
+	for (int i = 0; i < line_num; i++) {
+		const Instruction* line = &lines[i];
+		fprintf(file, "I %d %d %d %d %d %d %d %d %d\n", line->opcode, line->rd, line->rs, line->rt, line->immediate, line->label, line->expr, line->line_number, line->file);
+	}
+	// E type value
+	for (int i = 0; i < context->expr_token_count; i++) {
+		fprintf(file, "E %d %d\n", context->expr_tokens[i].type, context->expr_tokens[i].value);
+	}
+	// W address data expr line_number file
+	for (int i = 0; i < context->word_entries_count; i++) {
+		const WordEntry* entry = &context->word_entries[i];
+		fprintf(file, "W %d %d %d %d %d\n", entry->address, entry->data, entry->expr, entry->line_number, entry->file);
+	}
+
+	int result = ferror(file) ? -1 : 0;
+	fclose(file);
+	if (result != 0) {
+		printf("Error: Could not write output file.\n");
+	}
+	return result;
+}
+
+// Initializes an empty assembly job
+void context_init(AsmContext* context) {
+	memset(context, 0, sizeof(AsmContext));
+	symbols_init(&context->symbols);
+}
+
+// Frees the memory of an assembly job
+void context_free(AsmContext* context) {
+	free(context->lines);
+	free(context->word_entries);
+	free(context->expr_tokens);
+	free(context->loop_bounds);
+	for (int i = 0; i < context->file_num; i++) {
+		free(context->files[i]);
+	}
+	free(context->files);
+	symbols_free(&context->symbols);
+	memset(context, 0, sizeof(AsmContext));
+}
+
+// Adds a source file name to the context. Returns its index
+int context_add_file(AsmContext* context, const char* name) {
+	context->files = grow_array(context->files, &context->file_capacity, context->file_num, sizeof(char*));
+	context->files[context->file_num] = copy_string(name, strlen(name));
+	return context->file_num++;
+}
+
+// FNV-1a hash of a name
+unsigned int hash_name(const char* name, unsigned int seed) {
+	unsigned int hash = seed;
+	for (; *name; name++) {
+		hash ^= (unsigned char)*name;
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 15);
+}
+
+// Checks what the given word is
+int lookup_word(const char* word) {
+	unsigned int hash = hash_name(word, OPCODE_HASH_SEED);
+	if (word[0] == '$') {
+		int i = register_slots[hash & (REGISTER_HASH_SIZE - 1)];
+		if (i >= 0 && strcmp(register_table[i].RegisterEntryName, word) == 0) {
+			return register_table[i].number;
+		}
+		return -1;
+	}
+	else {
+		int i = opcode_slots[hash & (OPCODE_HASH_SIZE - 1)];
+		if (i >= 0 && strcmp(opcode_table[i].OpCodeName, word) == 0) {
+			return opcode_table[i].code;
+		}
+		return -1;
+	}
+}
+
+// Initialize an empty symbol table
+void symbols_init(SymbolTable* symbols) {
+	memset(symbols, 0, sizeof(SymbolTable));
+}
+
+// Free the symbol table memory
+void symbols_free(SymbolTable* symbols) {
+	free(symbols->labels);
+	free(symbols->slots);
+	free(symbols->names);
+	memset(symbols, 0, sizeof(SymbolTable));
+}
+
+// Returns the index of the label with the given name or -1 if not found
+int symbols_find(const SymbolTable* symbols, const char* name) {
+	if (symbols->slot_capacity == 0) {
+		return -1;
+	}
+	unsigned int mask = (unsigned int)symbols->slot_capacity - 1;
+	unsigned int slot = hash_name(name, LABEL_HASH_SEED) & mask;
+
+	// Linear probing until an empty slot
+	while (symbols->slots[slot] != 0) {
+		int index = symbols->slots[slot] - 1;
+		if (strcmp(symbols->names + symbols->labels[index].name, name) == 0) {
+			return index;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+// Rebuild the hash slots with double the capacity
+void symbols_grow(SymbolTable* symbols) {
+	int capacity = symbols->slot_capacity ? symbols->slot_capacity * 2 : 256;
+	int* slots = calloc((size_t)capacity, sizeof(int));
+	if (slots == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	unsigned int mask = (unsigned int)capacity - 1;
+	for (int i = 0; i < symbols->label_num; i++) {
+		unsigned int slot = hash_name(symbols->names + symbols->labels[i].name, LABEL_HASH_SEED) & mask;
+		while (slots[slot] != 0) { slot = (slot + 1) & mask; }
+		slots[slot] = i + 1;
+	}
+	free(symbols->slots);
+	symbols->slots = slots;
+	symbols->slot_capacity = capacity;
+}
+
+// Returns the index of the label with the given name, adds an undefined label if not found
+int symbols_intern(SymbolTable* symbols, const char* name) {
+	int index = symbols_find(symbols, name);
+	if (index >= 0) {
+		return index;
+	}
+
+	// Keep the table at most half full
+	if ((symbols->label_num + 1) * 2 > symbols->slot_capacity) {
+		symbols_grow(symbols);
+	}
+
+	// Copy the name to the names buffer
+	int length = (int)strlen(name) + 1;
+	if (symbols->names_size + length > symbols->names_capacity) {
+		int capacity = symbols->names_capacity ? symbols->names_capacity : 4096;
+		while (symbols->names_size + length > capacity) { capacity *= 2; }
+		char* names = realloc(symbols->names, (size_t)capacity);
+		if (names == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+		symbols->names = names;
+		symbols->names_capacity = capacity;
+	}
+	memcpy(symbols->names + symbols->names_size, name, (size_t)length);
+
+	// Add the label
+	if (symbols->label_num >= symbols->label_capacity) {
+		int capacity = symbols->label_capacity ? symbols->label_capacity * 2 : 128;
+		Lable* labels = realloc(symbols->labels, (size_t)capacity * sizeof(Lable));
+		if (labels == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+		symbols->labels = labels;
+		symbols->label_capacity = capacity;
+	}
+	index = symbols->label_num++;
+	symbols->labels[index].name = symbols->names_size;
+	symbols->labels[index].line_index = 0;
+	symbols->labels[index].position = 0;
+	symbols->labels[index].defined = 0;
+	symbols->labels[index].constant = 0;
+	symbols->labels[index].global = 0;
+	symbols->names_size += length;
+
+	// Insert in the first empty slot
+	unsigned int mask = (unsigned int)symbols->slot_capacity - 1;
+	unsigned int slot = hash_name(name, LABEL_HASH_SEED) & mask;
+	while (symbols->slots[slot] != 0) { slot = (slot + 1) & mask; }
+	symbols->slots[slot] = index + 1;
+	return index;
+}
+
+// Returns the name of the label
+const char* symbols_name(const SymbolTable* symbols, int index) {
+	return symbols->names + symbols->labels[index].name;
+}
+
+// Encodes the instruction in the correct format and writes the words to the code array
+int line_to_hexa(const Instruction* instruction, int* code) {
+	unsigned int encoded = 0;
+	int bigimm = instruction->is_bigimm;
+
+	// Encode the instruction
+	encoded |= (instruction->opcode & 0xFF) << 24;  // opcode
+	encoded |= (instruction->rd & 0xF) << 20;       // rd
+	encoded |= (instruction->rs & 0xF) << 16;       // rs
+	encoded |= (instruction->rt & 0xF) << 12;       // rt
+	encoded |= 0 << 9;                              // reserved
+	encoded |= bigimm << 8;                         // bigimm flag
+	encoded |= (bigimm ? 0 : (instruction->immediate & 0xFF));  // imm8 (if not bigimm)
+
+	code[0] = (int)encoded;
+
+	if (bigimm) {
+		code[1] = instruction->immediate;
+		return 2;
+	}
+	return 1;
+}
@@ -0,0 +1,294 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdio.h>
+#include "simp_asm.h"
+
+#define MEMORY_SIZE 4096 // Number of words in the SIMP memory
+#define MAX_MEMORY_SIZE (1 << 24) // Words the simulator can address with -addrbits 24
+#define OBJECT_MAGIC "SIMPOBJ" // First word of an object file
+#define OBJECT_VERSION 2
+#define MAP_MAGIC "SIMPMAP" // First word of a symbol map file
+#define MAP_VERSION 1
+#define IMAGE_MAGIC "SIMPMEM" // First word of a sparse text memory image
+#define IMAGE_BINARY_MAGIC "SIMPMEMB" // First 8 bytes of a sparse binary memory image
+#define IMAGE_VERSION 1
+#define IMAGE_MAX_GAP 2 // Zero words kept inside a run, a new record costs about as much
+
+#define OPCODE_HASH_SEED 2166306036u // FNV-1a seed that gives no collisions in the opcode and register tables
+#define LABEL_HASH_SEED 2166136261u // FNV-1a offset basis for label names
+#define OPCODE_HASH_SIZE 64 // Slots in the opcode perfect hash
+#define REGISTER_HASH_SIZE 32 // Slots in the register perfect hash
+#define MAX_JUMP_THREADING 16 // Max jumps followed when threading a branch
+#define MAX_TOKENS 10 // Max tokens in an instruction or macro invocation
+#define MACRO_MAX_PARAMS 8 // Max parameters of a macro
+#define MACRO_MAX_DEPTH 16 // Max nesting of macro expansions
+#define EXPR_MAX_DEPTH 64 // Max values on the expression evaluation stack
+
+// Expression token types, operators are stored as their character
+#define EXPR_END    0
+#define EXPR_NUMBER 1
+#define EXPR_SYMBOL 2
+#define EXPR_NEG    'n'
+#define EXPR_SHL    'L'
+#define EXPR_SHR    'R'
+
+// Opcodes used by the optimizer and the pseudo instructions
+#define OP_ADD   0
+#define OP_SUB   1
+#define OP_SRL   8
+#define OP_BEQ   9
+#define OP_BNE   10
+#define OP_BLT   11
+#define OP_BGT   12
+#define OP_BLE   13
+#define OP_BGE   14
+#define OP_JAL   15
+#define OP_LW    16
+#define OP_SW    17
+#define OP_RETI  18
+#define OP_IN    19
+#define OP_OUT   20
+#define OP_HALT  21
+
+// Pseudo instructions - codes in the opcode table that expand to real instructions
+#define PSEUDO_BASE 64
+#define PSEUDO_LI   64  // li $rd, K        => add $rd, $zero, $imm, K
+#define PSEUDO_MOVE 65  // move $rd, $rs    => add $rd, $rs, $zero, 0
+#define PSEUDO_B    66  // b label          => beq $imm, $zero, $zero, label
+#define PSEUDO_CALL 67  // call label       => jal $ra, $imm, $zero, label
+#define PSEUDO_RET  68  // ret              => beq $ra, $zero, $zero, 0
+#define PSEUDO_PUSH 69  // push $r1, ...    => sub $sp, $sp, $imm, n + sw for each register
+#define PSEUDO_POP  70  // pop $r1, ...     => lw for each register + add $sp, $sp, $imm, n
+
+// Registers used by the optimizer and the pseudo instructions
+#define REG_ZERO 0
+#define REG_IMM  1
+#define REG_SP   14
+#define REG_RA   15
+
+// Token types of the line lexer
+#define TOKEN_LABEL     1	// Label definition, or a label used as the immediate
+#define TOKEN_DIRECTIVE 2	// Directive name, with the dot
+#define TOKEN_MNEMONIC  3	// Opcode or pseudo instruction, value is its code
+#define TOKEN_NAME      4	// Word that is not an opcode, a macro invocation
+#define TOKEN_REGISTER  5	// Register, value is its number or -1 if the name is unknown
+#define TOKEN_NUMBER    6	// Number immediate, value is the number
+#define TOKEN_TEXT      7	// Expression immediate, or the operands of a directive or a macro
+
+// Character classes of the lexer. Token characters have the highest classes
+#define CHAR_END     0	// End of the line
+#define CHAR_COMMENT 1
+#define CHAR_SPACE   2
+#define CHAR_COMMA   3
+#define CHAR_COLON   4
+#define CHAR_WORD    5	// Letters, digits, '_', '.' and '$'
+#define CHAR_OTHER   6
+
+// Object of type Lable
+typedef struct Lable {
+	int name;		// Offset of the name in the symbol table names buffer
+	int line_index;	// Index of the instruction the label points to
+	int position;
+	int defined;	// 1 if the label was defined in the code
+	int constant;	// 1 if the label is a .equ constant, position holds the value
+	int global;		// 1 if the label is exported from the module with .global
+}Lable;
+
+// Symbol table - open addressing hash of label names
+typedef struct {
+	Lable* labels;		// Labels by index
+	int label_num;
+	int label_capacity;
+	int* slots;			// Hash slots, holds label index + 1 (0 = empty)
+	int slot_capacity;	// Power of 2
+	char* names;		// Interned label names
+	int names_size;
+	int names_capacity;
+} SymbolTable;
+
+// Object of type Instruction
+typedef struct {
+	char opcode_str[10];
+	int opcode;
+	int rd, rs, rt;
+	int immediate;
+	int has_label;
+	int is_bigimm;
+	int line_number;
+	int file;                // Index of the source file in the context files
+	int label;               // Symbol index of the immediate label
+	int expr;                // Expression of the immediate (index in expr_tokens, -1 if none)
+	int address;             // Address of the instruction
+} Instruction;
+
+typedef struct {
+	char OpCodeName[10];
+	int code;
+} OpcodeEntry;
+
+// Object of type Macro
+typedef struct {
+	int param_num;
+	char* params[MACRO_MAX_PARAMS];
+	char* body;		// Lines of the macro separated by '\n'
+	int body_size;
+	int body_capacity;
+} Macro;
+
+// Structure to store .word entries
+typedef struct {
+	int address;
+	int data;
+	int expr;		// Expression of the data if it uses labels, -1 if none
+	int line_number;
+	int file;		// Index of the source file in the context files
+} WordEntry;
+
+// Token of a source line
+typedef struct {
+	int type;		// TOKEN_ type
+	int value;		// Code, register or number of the token
+	char* text;		// Token text, terminated in the line
+	int column;		// Column of the token in the line, from 1
+} Token;
+
+// Token of an expression in reverse polish notation
+typedef struct {
+	int type;		// EXPR_NUMBER, EXPR_SYMBOL, EXPR_END or operator
+	int value;		// Number or symbol index
+} ExprToken;
+
+// Loop bound annotation: .loop N before the first instruction of a loop
+typedef struct {
+	int line_index;	// Index of the loop header instruction
+	int bound;		// Max number of times the header runs each time the loop is entered
+	int line_number;
+} LoopBound;
+
+typedef struct {
+	char RegisterEntryName[10];
+	int number;
+} RegisterEntry;
+
+// State of one assembly job. Jobs do not share any state, so they can run on several threads
+typedef struct {
+	Instruction* lines;
+	int line_num;
+	int line_capacity;
+	SymbolTable symbols;
+	WordEntry* word_entries;	// .word entries
+	int word_entries_count;
+	int word_entries_capacity;
+	ExprToken* expr_tokens;		// Expressions that depend on labels
+	int expr_token_count;
+	int expr_token_capacity;
+	char** files;				// Source files, for the symbol map
+	int file_num;
+	int file_capacity;
+	LoopBound* loop_bounds;		// .loop annotations, only used by the timing analyzer
+	int loop_bound_count;
+	int loop_bound_capacity;
+} AsmContext;
+
+// Parser state while going over the source
+typedef struct {
+	AsmContext* context;
+	SymbolTable* symbols;		// Symbols of the context
+	int file;					// Index of the source file in the context files
+	SymbolTable macro_names;	// Macro names, label index = index in macros
+	Macro* macros;
+	int macro_capacity;
+	int defining;		// Index of the macro being defined, -1 if none
+	int expansions;		// Number of macro expansions, used for \@
+	int depth;			// Current macro nesting
+	int errors;
+} Parser;
+
+// Expression parser state
+typedef struct {
+	const char* text;	// Current position in the expression text
+	Parser* parser;
+	int symbols;		// Number of label symbols in the expression
+	int error;
+} ExprParser;
+
+// Tables of the opcode and register names
+extern OpcodeEntry opcode_table[];
+extern int opcode_table_size;
+extern RegisterEntry register_table[];
+extern int register_table_size;
+extern const unsigned char char_class[256];
+
+// Function declarations
+char* read_source(const char* filename);
+void* grow_array(void* array, int* capacity, int count, size_t element_size);
+char* copy_string(const char* text, size_t length);
+char* next_line(char* line);
+char* take_token(char** cursor);
+char* take_rest(char** cursor);
+char* skip_spaces(char* c, int commas);
+char* scan_token(char* c);
+void add_token(Token tokens[], int* token_num, int type, int value, char* start, char* end, const char* line);
+int lex_line(char* line, Token tokens[], int max_tokens);
+int parse_source(AsmContext* context, char* source, const char* filename);
+void parse_line(Parser* parser, char* line, int line_number);
+int parse_instruction(Parser* parser, Token tokens[], int token_num, int line_number);
+int parse_register(const char* token, int line_number);
+int add_instruction(Parser* parser, int opcode, int rd, int rs, int rt, const char* immediate, int value, int line_number);
+int expand_pseudo(Parser* parser, int code, char* args[], int arg_num, int line_number);
+void define_macro(Parser* parser, char* text, int line_number);
+void append_text(Macro* macro, const char* text, size_t length);
+int expand_macro(Parser* parser, int index, char* args[], int arg_num, int line_number);
+void parse_word_entry(Parser* parser, char* text, int line_number);
+void parse_equ(Parser* parser, char* text, int line_number);
+void parse_global(Parser* parser, char* text, int line_number);
+void parse_loop(Parser* parser, char* text, int line_number);
+int parse_expression(Parser* parser, const char* text, int line_number, int* value, int* expr, int* label);
+void add_expr_token(AsmContext* context, int type, int value);
+void compile_expression(ExprParser* ep, int min_precedence);
+void compile_operand(ExprParser* ep);
+int operator_precedence(const char* text, int* op, int* length);
+int evaluate_expression(const AsmContext* context, int expr);
+int resolve_immediate(const AsmContext* context, const Instruction* instruction);
+int check_symbols(const AsmContext* context);
+int Get_labels(AsmContext* context);
+int writes_register(const Instruction* instruction);
+int reads_register(const Instruction* instruction, int reg);
+int is_jump(const Instruction* instruction);
+int is_label_target(const Instruction* instruction);
+int next_kept(const char removed[], int line_num, int index);
+int register_is_dead_after(const Instruction lines[], const char removed[], const char label_at[], int line_num, int index, int reg);
+void freeze_label(const SymbolTable* symbols, int label, const char* label_at, char* frozen, int line_num);
+int optimize_program(AsmContext* context);
+int compare_word_entries(const void* a, const void* b);
+int encode_program(AsmContext* context, int** image);
+int assembler_second_run(AsmContext* context, const char* filename, int format);
+int assemble_source_file(const char* input, const char* output, int optimize, int object, int debug, int format);
+int run_batch(const char* path, int optimize, int thread_num, int debug, int format);
+int write_memory_image(AsmContext* context, int optimize, const char* filename, const char* map_filename, int format);
+int image_word(const int* const* pages, int page_words, int address);
+int next_run(const int* const* pages, int page_words, int word_num, int start, int* end);
+void write_u32(FILE* file, unsigned int value);
+int read_u32(FILE* file, unsigned int* value);
+int read_sparse_text(FILE* file, int* words, int capacity);
+int read_sparse_binary(FILE* file, int* words, int capacity);
+int write_map(const AsmContext* context, const char* filename);
+int compare_map_labels(const void* a, const void* b);
+int write_object(const AsmContext* context, const char* filename);
+unsigned int hash_name(const char* name, unsigned int seed);
+int lookup_word(const char* word);
+void context_init(AsmContext* context);
+void context_free(AsmContext* context);
+int context_add_file(AsmContext* context, const char* name);
+void symbols_init(SymbolTable* symbols);
+void symbols_free(SymbolTable* symbols);
+int symbols_find(const SymbolTable* symbols, const char* name);
+void symbols_grow(SymbolTable* symbols);
+int symbols_intern(SymbolTable* symbols, const char* name);
+const char* symbols_name(const SymbolTable* symbols, int index);
+int line_to_hexa(const Instruction* instruction, int* code);
+int parse_number(const char* token, const char** end); // parse numbers (decimal/hex)
+void remove_comments(char* line); // remove comments from line
+
+#endif // ASSEMBLER_H
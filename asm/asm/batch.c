@@ -0,0 +1,273 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "assembler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// One file of a batch
+typedef struct {
+	char* input;
+	char* output;
+	int result;		// 0 if the file was assembled
+} BatchJob;
+
+// Jobs of a batch, shared by the workers
+typedef struct {
+	BatchJob* jobs;
+	int job_num;
+	int job_capacity;
+	int next_job;	// Next job to take, guarded by lock
+	mtx_t lock;
+	int optimize;
+	int debug;		// Write the symbol maps
+	int format;		// Format of the memory images
+} Batch;
+
+// Function declarations
+int batch_worker(void* arg);
+void add_batch_job(Batch* batch, const char* input, const char* output);
+char* take_path(char** cursor);
+int read_batch_list(Batch* batch, const char* filename);
+int read_batch_directory(Batch* batch, const char* path);
+int is_directory(const char* path);
+int processor_count(void);
+
+// Assembles all the sources of a list file or a directory on a pool of threads.
+// A list file has one source per line, optionally followed by its output file. Paths with spaces are quoted.
+// Sources without an output file are written next to the source as name.memin.txt, or name.memin.bin
+// for binary images. Returns the number of files that failed, or -1 if the list could not be read
+int run_batch(const char* path, int optimize, int thread_num, int debug, int format) {
+	Batch batch;
+	thrd_t* threads;
+	int failed = 0;
+
+	memset(&batch, 0, sizeof(Batch));
+	batch.optimize = optimize;
+	batch.debug = debug;
+	batch.format = format;
+	if ((is_directory(path) ? read_batch_directory(&batch, path) : read_batch_list(&batch, path)) != 0) {
+		return -1;
+	}
+
+	// One worker per processor, but not more workers than files
+	if (thread_num <= 0) {
+		thread_num = processor_count();
+	}
+	if (thread_num > batch.job_num) {
+		thread_num = batch.job_num;
+	}
+
+	threads = malloc(((size_t)thread_num + 1) * sizeof(thrd_t));
+	if (threads == NULL || mtx_init(&batch.lock, mtx_plain) != thrd_success) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	int started = 0;
+	for (; started < thread_num; started++) {
+		if (thrd_create(&threads[started], batch_worker, &batch) != thrd_success) {
+			break;
+		}
+	}
+	// Work on the calling thread too if no thread could be started
+	if (started == 0) {
+		batch_worker(&batch);
+	}
+	for (int i = 0; i < started; i++) {
+		thrd_join(threads[i], NULL);
+	}
+	mtx_destroy(&batch.lock);
+	free(threads);
+
+	// Report the files that failed
+	for (int i = 0; i < batch.job_num; i++) {
+		if (batch.jobs[i].result != 0) {
+			printf("Error: Could not assemble '%s'\n", batch.jobs[i].input);
+			failed++;
+		}
+		free(batch.jobs[i].input);
+		free(batch.jobs[i].output);
+	}
+	printf("Assembled %d of %d files\n", batch.job_num - failed, batch.job_num);
+	free(batch.jobs);
+	return failed;
+}
+
+// Takes jobs from the batch until there are none left
+int batch_worker(void* arg) {
+	Batch* batch = (Batch*)arg;
+
+	for (;;) {
+		mtx_lock(&batch->lock);
+		int index = batch->next_job++;
+		mtx_unlock(&batch->lock);
+
+		if (index >= batch->job_num) {
+			return 0;
+		}
+		BatchJob* job = &batch->jobs[index];
+		job->result = assemble_source_file(job->input, job->output, batch->optimize, 0, batch->debug, batch->format);
+	}
+}
+
+// Adds a file to the batch. Without an output file, the .asm extension is replaced by .memin.txt,
+// or by .memin.bin for binary images
+void add_batch_job(Batch* batch, const char* input, const char* output) {
+	const char* extension = batch->format == IMAGE_BINARY ? ".memin.bin" : ".memin.txt";
+	size_t length = strlen(input);
+
+	batch->jobs = grow_array(batch->jobs, &batch->job_capacity, batch->job_num, sizeof(BatchJob));
+	BatchJob* job = &batch->jobs[batch->job_num++];
+	job->input = copy_string(input, length);
+	job->result = -1;
+
+	if (output != NULL) {
+		job->output = copy_string(output, strlen(output));
+		return;
+	}
+	if (length > 4 && strcmp(input + length - 4, ".asm") == 0) {
+		length -= 4;
+	}
+	job->output = malloc(length + strlen(extension) + 1);
+	if (job->output == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	memcpy(job->output, input, length);
+	strcpy(job->output + length, extension);
+}
+
+// Returns the next path of a list line and moves the cursor after it. Paths are separated by spaces or tabs,
+// a path in double quotes can have spaces and #. A # outside quotes starts a comment up to the end of the line
+char* take_path(char** cursor) {
+	char* path = *cursor;
+	while (*path == ' ' || *path == '\t' || *path == '\r') { path++; }
+	if (*path == '\0' || *path == '#') {
+		*cursor = path;
+		return NULL;
+	}
+	char* end;
+	if (*path == '"') {
+		path++;
+		end = path + strcspn(path, "\"");
+	}
+	else {
+		end = path + strcspn(path, " \t\r#");
+	}
+	// Nothing is read after a comment
+	*cursor = *end && *end != '#' ? end + 1 : end;
+	*end = '\0';
+	return path;
+}
+
+// Reads the sources from a list file: source [output] per line
+int read_batch_list(Batch* batch, const char* filename) {
+	char* source = read_source(filename);
+	if (source == NULL) {
+		printf("Error: Could not open batch list '%s'.\n", filename);
+		return -1;
+	}
+
+	for (char* line = source; *line != '\0';) {
+		char* next = next_line(line);
+		char* cursor = line;
+		char* input = take_path(&cursor);
+		if (input != NULL) {
+			add_batch_job(batch, input, take_path(&cursor));
+		}
+		line = next;
+	}
+	free(source);
+	return 0;
+}
+
+// Reads the .asm files of a directory
+int read_batch_directory(Batch* batch, const char* path) {
+	size_t length = strlen(path);
+	char* name = NULL;
+	size_t name_capacity = 0;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	char* pattern = malloc(length + sizeof("\\*.asm"));
+	if (pattern == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	sprintf(pattern, "%s\\*.asm", path);
+	HANDLE find = FindFirstFileA(pattern, &entry);
+	free(pattern);
+	if (find == INVALID_HANDLE_VALUE) {
+		return 0;
+	}
+	do {
+		const char* file = entry.cFileName;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			continue;
+		}
+#else
+	DIR* directory = opendir(path);
+	if (directory == NULL) {
+		printf("Error: Could not open directory '%s'.\n", path);
+		return -1;
+	}
+	for (struct dirent* entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+		const char* file = entry->d_name;
+		size_t file_length = strlen(file);
+		if (file_length <= 4 || strcmp(file + file_length - 4, ".asm") != 0) {
+			continue;
+		}
+#endif
+		// Full path of the source
+		size_t needed = length + strlen(file) + 2;
+		if (needed > name_capacity) {
+			free(name);
+			name_capacity = needed * 2;
+			name = malloc(name_capacity);
+			if (name == NULL) {
+				printf("Error: Out of memory\n");
+				exit(1);
+			}
+		}
+		snprintf(name, name_capacity, "%s/%s", path, file);
+		add_batch_job(batch, name, NULL);
+#ifdef _WIN32
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	}
+	closedir(directory);
+#endif
+
+	free(name);
+	return 0;
+}
+
+// Checks if the path is a directory
+int is_directory(const char* path) {
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat info;
+	return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// Returns the number of processors, used as the default number of workers
+int processor_count(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef SIMP_ASM_H
+#define SIMP_ASM_H
+
+// In-process interface of the SIMP assembler, used by tools that assemble without the asm program
+
+// Label or constant of an assembled program
+typedef struct {
+	const char* name;
+	int value;		// Address of the label or value of the constant
+} AssembledSymbol;
+
+// Memory image and symbols of an assembled program
+typedef struct {
+	int* words;					// Memory words from address 0
+	int word_num;
+	AssembledSymbol* symbols;
+	int symbol_num;
+	char* names;				// Buffer that holds the symbol names
+} AssembledProgram;
+
+// Memory image file formats
+#define IMAGE_DENSE  0	// One hex word per line from address 0, the memin.txt format
+#define IMAGE_SPARSE 1	// Text records of an address and a run of words, zero words between the runs are left out
+#define IMAGE_BINARY 2	// The sparse records as little endian 32 bit numbers
+
+// Assembles source text into memory words. Errors are printed. Returns 0 on success
+int assemble_program(const char* source, int optimize, AssembledProgram* program);
+// Reads and assembles a source file. Returns 0 on success
+int assemble_file(const char* filename, int optimize, AssembledProgram* program);
+// Frees the memory of an assembled program
+void free_assembled_program(AssembledProgram* program);
+// Writes memory words to an image file in one of the formats. Returns 0 on success
+int write_image_file(const char* filename, const int* words, int word_num, int format);
+// Writes an image that is split into pages of page_words words, a NULL page is all zeros. Returns 0 on success
+int write_paged_image_file(const char* filename, const int* const* pages, int page_words, int word_num, int format);
+// Reads an image file of any of the formats into words, which are cleared first.
+// Returns the size of the image in words up to the capacity, or -1 if the file could not be read
+int read_image_file(const char* filename, int* words, int capacity);
+
+#endif // SIMP_ASM_H
@@ -0,0 +1,491 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../asm/assembler.h"
+
+#define BENCH_DEFAULT_SIZE 100000 // Instructions of the base case
+#define BENCH_DEFAULT_REPEATS 3 // Runs of every case, the fastest counts
+#define BENCH_DEFAULT_TOLERANCE 10 // Percent a result may be worse than the baseline
+#define BENCH_MAX_CASES 16
+
+// Shape of a generated program
+typedef struct {
+	int instructions;		// Number of instructions
+	int label_density;		// Labels per 100 instructions
+	int words;				// Number of .word entries
+	int comment_ratio;		// Percent of lines with a comment
+	unsigned int seed;
+} GenOptions;
+
+// Growing text buffer for a generated program
+typedef struct {
+	char* text;
+	size_t size;
+	size_t capacity;
+} TextBuffer;
+
+// Result of one benchmark case
+typedef struct {
+	char name[32];
+	int lines;
+	int labels;
+	double seconds;			// Fastest run
+	double lines_per_second;
+	long peak_kb;			// Peak memory of the process that ran the case
+} BenchResult;
+
+// Function declarations
+unsigned int next_random(unsigned int* state);
+void append_format(TextBuffer* buffer, const char* format, ...);
+int table_address(const GenOptions* options);
+char* generate_program(const GenOptions* options, int* line_num);
+int run_generate(int argc, char* argv[]);
+int run_case(const GenOptions* options, int repeats, BenchResult* result);
+int run_case_process(int argc, char* argv[]);
+int spawn_case(const char* program, const char* name, const GenOptions* options, int repeats, BenchResult* result);
+double now_seconds(void);
+long peak_memory_kb(void);
+int save_results(const char* filename, const BenchResult results[], int result_num);
+int check_results(const char* filename, const BenchResult results[], int result_num, int tolerance);
+
+int main(int argc, char* argv[])
+{
+	BenchResult results[BENCH_MAX_CASES];
+	int result_num = 0;
+	int size = BENCH_DEFAULT_SIZE;
+	int repeats = BENCH_DEFAULT_REPEATS;
+	int tolerance = BENCH_DEFAULT_TOLERANCE;
+	const char* save_file = NULL;
+	const char* check_file = NULL;
+	int valid = 1;
+
+	// simp-bench gen writes one program to a file
+	if (argc >= 2 && strcmp(argv[1], "gen") == 0) {
+		return run_generate(argc, argv);
+	}
+	// simp-bench case runs one case for the parent process
+	if (argc >= 2 && strcmp(argv[1], "case") == 0) {
+		return run_case_process(argc, argv);
+	}
+
+	// Get the options
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			size = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			repeats = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+			save_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+			check_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = atoi(argv[++i]);
+		}
+		else {
+			valid = 0;
+		}
+	}
+
+	// validate the options
+	if (!valid || size <= 0 || repeats <= 0 || tolerance < 0) {
+		printf("Usage: %s [-n instructions] [-r repeats] [--save baseline] [--check baseline] [--tolerance percent]\n", argv[0]);
+		printf("       %s gen [-n instructions] [-l labels_per_100] [-w words] [-c comment_percent] [-s seed] <output_file>\n", argv[0]);
+		printf("--check fails if a case is slower or uses more memory than the baseline by more than the tolerance\n");
+		return 1;
+	}
+	// The largest case has 10 times the instructions
+	GenOptions largest = { size <= MAX_MEMORY_SIZE / 10 ? size * 10 : MAX_MEMORY_SIZE, 10, 64, 30, 1 };
+	if (table_address(&largest) < 0) {
+		printf("Error: The .word tables of %lld instructions do not fit in %d words of memory\n", (long long)size * 10, MAX_MEMORY_SIZE);
+		return 1;
+	}
+
+	// Scaling with the label count at the base size, then with the program size.
+	// Every case runs in its own process, so its peak memory is not the one of a larger case before it
+	GenOptions options = { size, 10, 64, 30, 1 };
+	char name[32];
+	printf("%-16s %10s %8s %10s %12s %10s\n", "case", "lines", "labels", "time ms", "lines/s", "peak KB");
+	static const int densities[] = { 1, 5, 10, 25, 50 };
+	for (int i = 0; i < 5; i++) {
+		options.instructions = size;
+		options.label_density = densities[i];
+		snprintf(name, sizeof(name), "labels-%d%%", densities[i]);
+		if (spawn_case(argv[0], name, &options, repeats, &results[result_num]) != 0) {
+			return 1;
+		}
+		result_num++;
+	}
+	options.label_density = 10;
+	for (int scale = 1; scale <= 100; scale *= 10) {
+		options.instructions = size / 10 * scale > 0 ? size / 10 * scale : 1;
+		snprintf(name, sizeof(name), "size-%d", options.instructions);
+		if (spawn_case(argv[0], name, &options, scale == 100 ? 1 : repeats, &results[result_num]) != 0) {
+			return 1;
+		}
+		result_num++;
+	}
+
+	if (save_file != NULL && save_results(save_file, results, result_num) != 0) {
+		return 1;
+	}
+	if (check_file != NULL) {
+		return check_results(check_file, results, result_num, tolerance) == 0 ? 0 : 1;
+	}
+	return 0;
+}
+
+// xorshift32, the same programs are generated on every platform
+unsigned int next_random(unsigned int* state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Appends formatted text to the buffer
+void append_format(TextBuffer* buffer, const char* format, ...) {
+	va_list args;
+	for (;;) {
+		size_t room = buffer->capacity - buffer->size;
+		va_start(args, format);
+		int length = vsnprintf(buffer->text + buffer->size, room, format, args);
+		va_end(args);
+		if (length < 0) {
+			return;
+		}
+		if ((size_t)length < room) {
+			buffer->size += (size_t)length;
+			return;
+		}
+		buffer->capacity = buffer->capacity * 2 + (size_t)length + 1;
+		buffer->text = realloc(buffer->text, buffer->capacity);
+		if (buffer->text == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+	}
+}
+
+// Address of the data tables: 0xC00 when the code fits below it, otherwise the next 0x400 words after the
+// code, which needs a simulator run with -addrbits. Returns -1 if the tables do not fit in the largest memory
+int table_address(const GenOptions* options) {
+	// An instruction takes at most 2 words
+	long long code_words = (long long)options->instructions * 2;
+	long long address = code_words < 0xC00 ? 0xC00 : (code_words + 0x3FF) / 0x400 * 0x400;
+	return address + 0x400 <= MAX_MEMORY_SIZE ? (int)address : -1;
+}
+
+// Generates a program in the style of the samples: loops over memory with lw/sw, counters, calls to
+// functions that save $ra on the stack, IO writes and .word data. Returns the source text
+char* generate_program(const GenOptions* options, int* line_num) {
+	static const char* registers[] = { "$v0", "$a0", "$a1", "$a2", "$t0", "$t1", "$t2", "$s0", "$s1", "$s2" };
+	static const char* alu[] = { "add", "sub", "mul", "and", "or", "xor", "sll", "sra", "srl" };
+	static const char* branches[] = { "beq", "bne", "blt", "bgt", "ble", "bge" };
+	static const char* comments[] = { "next element", "update the counter", "load the value", "store the result",
+		"check the loop condition", "address of the buffer", "save the return address" };
+	TextBuffer buffer = { NULL, 0, 0 };
+	// The data tables go after the code, a .word inside the code is a warning
+	int tables = table_address(options);
+	unsigned int state = options->seed ? options->seed : 1;
+	int label_num = 0;
+	int function_num = 0;
+	int lines = 0;
+
+	append_format(&buffer, "# Generated SIMP program: %d instructions, %d labels per 100, %d words\n",
+		options->instructions, options->label_density, options->words);
+	append_format(&buffer, "\tadd $sp, $zero, $imm, 4095\t\t# stack at the end of memory\n");
+	lines += 2;
+
+	for (int i = 1; i < options->instructions; i++) {
+		const char* rd = registers[next_random(&state) % 10];
+		const char* rs = registers[next_random(&state) % 10];
+		const char* rt = registers[next_random(&state) % 10];
+		int kind = (int)(next_random(&state) % 100);
+
+		// Labels start loops and functions
+		if ((int)(next_random(&state) % 100) < options->label_density) {
+			if (next_random(&state) % 8 == 0) {
+				append_format(&buffer, "func%d:\n", function_num++);
+			}
+			else {
+				append_format(&buffer, "L%d:\n", label_num++);
+			}
+			lines++;
+		}
+
+		if (kind < 45) {
+			append_format(&buffer, "\t%s %s, %s, $imm, %d", alu[next_random(&state) % 9], rd, rs, (int)(next_random(&state) % 200) - 100);
+		}
+		else if (kind < 55) {
+			append_format(&buffer, "\t%s %s, %s, %s, 0", alu[next_random(&state) % 9], rd, rs, rt);
+		}
+		else if (kind < 65) {
+			append_format(&buffer, "\tlw %s, %s, $imm, %d", rd, rs, (int)(next_random(&state) % 256));
+		}
+		else if (kind < 72) {
+			append_format(&buffer, "\tsw %s, $sp, $imm, %d", rd, (int)(next_random(&state) % 8));
+		}
+		else if (kind < 85 && label_num > 0) {
+			// Mostly backward branches of loops, some forward
+			int target = label_num - 1 - (int)(next_random(&state) % (label_num < 4 ? label_num : 4));
+			if (next_random(&state) % 4 == 0) {
+				target = label_num + (int)(next_random(&state) % 4);
+			}
+			append_format(&buffer, "\t%s $imm, %s, %s, L%d", branches[next_random(&state) % 6], rs, rt, target);
+		}
+		else if (kind < 90 && function_num > 0) {
+			append_format(&buffer, "\tjal $ra, $imm, $zero, func%d", (int)(next_random(&state) % function_num));
+		}
+		else if (kind < 94) {
+			append_format(&buffer, "\tout %s, $zero, $imm, %d", rs, 9 + (int)(next_random(&state) % 2));
+		}
+		else if (kind < 97) {
+			append_format(&buffer, "\tadd %s, $zero, $imm, 0x%X", rd, 0x100 + (int)(next_random(&state) % 0xE00));
+		}
+		else {
+			append_format(&buffer, "\tbeq $ra, $zero, $zero, 0");
+		}
+		if ((int)(next_random(&state) % 100) < options->comment_ratio) {
+			append_format(&buffer, "\t\t# %s", comments[next_random(&state) % 7]);
+		}
+		append_format(&buffer, "\n");
+		lines++;
+	}
+
+	// Every label that a forward branch may use, and the functions
+	for (int i = 0; i < 4; i++) {
+		append_format(&buffer, "L%d:\n", label_num++);
+		lines++;
+	}
+	append_format(&buffer, "\thalt $zero, $zero, $zero, 0\n");
+	lines++;
+	if (function_num == 0) {
+		append_format(&buffer, "func0:\n\tbeq $ra, $zero, $zero, 0\n");
+		lines += 2;
+	}
+
+	// Data tables
+	for (int i = 0; i < options->words; i++) {
+		append_format(&buffer, ".word 0x%03X %d\n", tables + (int)(next_random(&state) % 0x400), (int)(next_random(&state) % 100000));
+		lines++;
+	}
+
+	*line_num = lines;
+	return buffer.text;
+}
+
+// simp-bench gen [options] output: writes one generated program
+int run_generate(int argc, char* argv[]) {
+	GenOptions options = { BENCH_DEFAULT_SIZE, 10, 64, 30, 1 };
+	const char* output = NULL;
+	int line_num;
+
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			options.instructions = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			options.label_density = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			options.words = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			options.comment_ratio = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			options.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		}
+		else if (argv[i][0] != '-' && output == NULL) {
+			output = argv[i];
+		}
+		else {
+			output = NULL;
+			break;
+		}
+	}
+	if (output == NULL || options.instructions <= 0 || options.words < 0) {
+		printf("Usage: %s gen [-n instructions] [-l labels_per_100] [-w words] [-c comment_percent] [-s seed] <output_file>\n", argv[0]);
+		return 1;
+	}
+	if (options.words > 0 && table_address(&options) < 0) {
+		printf("Error: The .word tables of %d instructions do not fit in %d words of memory\n", options.instructions, MAX_MEMORY_SIZE);
+		return 1;
+	}
+
+	char* source = generate_program(&options, &line_num);
+	FILE* file = fopen(output, "w");
+	if (file == NULL) {
+		printf("Error: Could not open output file.\n");
+		free(source);
+		return 1;
+	}
+	fputs(source, file);
+	fclose(file);
+	free(source);
+	printf("Wrote %d lines to %s\n", line_num, output);
+	return 0;
+}
+
+// Generates a program and assembles it in process. The fastest of the runs is kept
+int run_case(const GenOptions* options, int repeats, BenchResult* result) {
+	AssembledProgram program;
+	int line_num;
+	char* source = generate_program(options, &line_num);
+
+	memset(result, 0, sizeof(BenchResult));
+	result->lines = line_num;
+	for (int i = 0; i < repeats; i++) {
+		double start = now_seconds();
+		if (assemble_program(source, 0, &program) != 0) {
+			free(source);
+			return -1;
+		}
+		double seconds = now_seconds() - start;
+		if (i == 0 || seconds < result->seconds) {
+			result->seconds = seconds;
+		}
+		result->labels = program.symbol_num;
+		free_assembled_program(&program);
+	}
+	free(source);
+
+	result->lines_per_second = result->seconds > 0 ? result->lines / result->seconds : 0;
+	result->peak_kb = peak_memory_kb();
+	return 0;
+}
+
+// simp-bench case <instructions> <labels_per_100> <repeats>: runs one case and prints
+// lines, labels, seconds and peak KB for spawn_case
+int run_case_process(int argc, char* argv[]) {
+	GenOptions options = { BENCH_DEFAULT_SIZE, 10, 64, 30, 1 };
+	BenchResult result;
+
+	if (argc != 5) {
+		printf("Usage: %s case <instructions> <labels_per_100> <repeats>\n", argv[0]);
+		return 1;
+	}
+	options.instructions = atoi(argv[2]);
+	options.label_density = atoi(argv[3]);
+	if (options.instructions <= 0 || run_case(&options, atoi(argv[4]) > 0 ? atoi(argv[4]) : 1, &result) != 0) {
+		return 1;
+	}
+	printf("%d %d %.9f %ld\n", result.lines, result.labels, result.seconds, result.peak_kb);
+	return 0;
+}
+
+// Runs a case in a new process of this program and prints its result
+int spawn_case(const char* program, const char* name, const GenOptions* options, int repeats, BenchResult* result) {
+	char command[1024];
+
+	memset(result, 0, sizeof(BenchResult));
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	snprintf(command, sizeof(command), "\"%s\" case %d %d %d", program, options->instructions, options->label_density, repeats);
+	FILE* pipe = popen(command, "r");
+	if (pipe == NULL) {
+		printf("Error: Could not run case '%s'\n", name);
+		return -1;
+	}
+	int fields = fscanf(pipe, "%d %d %lf %ld", &result->lines, &result->labels, &result->seconds, &result->peak_kb);
+	if (pclose(pipe) != 0 || fields != 4) {
+		printf("Error: The generated program of case '%s' did not assemble\n", name);
+		return -1;
+	}
+
+	result->lines_per_second = result->seconds > 0 ? result->lines / result->seconds : 0;
+	printf("%-16s %10d %8d %10.2f %12.0f %10ld\n", result->name, result->lines, result->labels, result->seconds * 1000,
+		result->lines_per_second, result->peak_kb);
+	return 0;
+}
+
+// Wall clock time in seconds
+double now_seconds(void) {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Peak memory of the process in KB
+long peak_memory_kb(void) {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (long)(counters.PeakWorkingSetSize / 1024);
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		return (long)usage.ru_maxrss;
+	}
+	return 0;
+#endif
+}
+
+// Writes the results as a baseline: name, lines per second and peak KB per line
+int save_results(const char* filename, const BenchResult results[], int result_num) {
+	FILE* file = fopen(filename, "w");
+	if (file == NULL) {
+		printf("Error: Could not open baseline file '%s'.\n", filename);
+		return -1;
+	}
+	for (int i = 0; i < result_num; i++) {
+		fprintf(file, "%s %.0f %ld\n", results[i].name, results[i].lines_per_second, results[i].peak_kb);
+	}
+	fclose(file);
+	return 0;
+}
+
+// Compares the results with a baseline. Returns the number of cases that got worse than the tolerance
+int check_results(const char* filename, const BenchResult results[], int result_num, int tolerance) {
+	FILE* file = fopen(filename, "r");
+	char line[128];
+	int failed = 0;
+
+	if (file == NULL) {
+		printf("Error: Could not open baseline file '%s'.\n", filename);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		char name[32];
+		double lines_per_second;
+		long peak_kb;
+		if (sscanf(line, "%31s %lf %ld", name, &lines_per_second, &peak_kb) != 3) {
+			continue;
+		}
+		for (int i = 0; i < result_num; i++) {
+			if (strcmp(results[i].name, name) != 0) {
+				continue;
+			}
+			if (results[i].lines_per_second < lines_per_second * (100 - tolerance) / 100) {
+				printf("Regression: %s runs at %.0f lines/s, the baseline is %.0f\n", name, results[i].lines_per_second, lines_per_second);
+				failed++;
+			}
+			if (results[i].peak_kb > peak_kb * (100 + tolerance) / 100) {
+				printf("Regression: %s uses %ld KB, the baseline is %ld KB\n", name, results[i].peak_kb, peak_kb);
+				failed++;
+			}
+		}
+	}
+	fclose(file);
+	printf(failed ? "%d regressions\n" : "No regressions\n", failed);
+	return failed;
+}
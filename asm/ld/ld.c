@@ -0,0 +1,287 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../asm/assembler.h"
+
+// Function declarations
+int link_object(AsmContext* context, const char* filename);
+int link_symbol(const char* filename, char* text, SymbolTable* symbols, int base_line);
+int read_fields(char** cursor, int values[], int count);
+
+int main(int argc, char* argv[])
+{
+	AsmContext context;
+	const char* output = NULL;
+	int optimize = 0;
+	int debug = 0;
+	int format = IMAGE_DENSE;
+	int object_num = 0;
+	int errors = 0;
+
+	// Get the options, the objects are the other arguments
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-O") == 0) {
+			optimize = 1;
+		}
+		else if (strcmp(argv[i], "-g") == 0) {
+			debug = 1;
+		}
+		else if (strcmp(argv[i], "-s") == 0) {
+			format = IMAGE_SPARSE;
+		}
+		else if (strcmp(argv[i], "-b") == 0) {
+			format = IMAGE_BINARY;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (argv[i][0] != '-') {
+			object_num++;
+		}
+		else {
+			output = NULL;
+			break;
+		}
+	}
+
+	// validate number of arguments
+	if (output == NULL || object_num == 0) {
+		printf("Usage: %s [-O] [-g] [-s|-b] -o <output_file> <object_file> ...\n", argv[0]);
+		printf("The first object is placed at address 0. -g writes the symbol map to <output_file>.map\n");
+		printf("-s writes a sparse memory image without the zero padding, -b writes it in binary\n");
+		return 1;
+	}
+
+	// Append the modules in the given order
+	context_init(&context);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0) {
+			i++;
+		}
+		else if (argv[i][0] != '-' && link_object(&context, argv[i]) != 0) {
+			errors++;
+		}
+	}
+
+	// Every import must be exported by one of the modules
+	if (errors == 0) {
+		errors = check_symbols(&context);
+	}
+
+	// Relaxation and encoding are done on the whole program
+	int result = -1;
+	if (errors == 0) {
+		char* map_filename = NULL;
+		if (debug) {
+			map_filename = malloc(strlen(output) + sizeof(".map"));
+			if (map_filename == NULL) {
+				printf("Error: Out of memory\n");
+				exit(1);
+			}
+			sprintf(map_filename, "%s.map", output);
+		}
+		result = write_memory_image(&context, optimize, output, map_filename, format);
+		free(map_filename);
+	}
+
+	context_free(&context);
+
+	return result < 0 ? 1 : 0;
+}
+
+// Reads an object file and appends its instructions, expressions and .word entries to the program.
+// Exported and imported symbols are shared by name, the other labels of the module are renamed to
+// "file:label" so modules can use the same local names. Returns 0 on success
+int link_object(AsmContext* context, const char* filename) {
+	SymbolTable* symbols = &context->symbols;
+	char* source = read_source(filename);
+	char* line;
+	char* cursor;
+	int header[6];
+	int symbol_num = 0;
+	int file_num = 0;
+	int base_line = context->line_num;
+	int base_expr = context->expr_token_count;
+	int errors = 0;
+	int reported = 0;
+
+	if (source == NULL) {
+		printf("Error: Could not open object file '%s'.\n", filename);
+		return -1;
+	}
+
+	// Header: magic, version and the number of records
+	line = source;
+	cursor = line;
+	line = next_line(line);
+	char* magic = take_token(&cursor);
+	if (magic == NULL || strcmp(magic, OBJECT_MAGIC) != 0 || read_fields(&cursor, header, 6) != 0 || header[0] != OBJECT_VERSION) {
+		printf("Error: '%s' is not a SIMP object file.\n", filename);
+		free(source);
+		return -1;
+	}
+
+	int* map = malloc(((size_t)header[1] + 1) * sizeof(int));
+	int* file_map = malloc(((size_t)header[5] + 1) * sizeof(int));
+	if (map == NULL || file_map == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	while (*line != '\0' && errors == 0) {
+		int values[9];
+		cursor = line + 1;
+		line = next_line(line);
+
+		switch (cursor[-1]) {
+		case 'F':
+			if (file_num >= header[5] || read_fields(&cursor, values, 1) != 0 || (cursor = take_rest(&cursor)) == NULL) {
+				errors++;
+				break;
+			}
+			file_map[file_num++] = context_add_file(context, cursor);
+			break;
+
+		case 'S':
+			if (symbol_num >= header[1]) {
+				errors++;
+				break;
+			}
+			map[symbol_num] = link_symbol(filename, cursor, symbols, base_line);
+			if (map[symbol_num] < 0) {
+				reported = map[symbol_num] == -2;
+				errors++;
+			}
+			symbol_num++;
+			break;
+
+		case 'I':
+			if (read_fields(&cursor, values, 9) != 0 || values[5] >= symbol_num || values[6] >= header[3] || values[8] < 0 || values[8] >= file_num) {
+				errors++;
+				break;
+			}
+			context->lines = grow_array(context->lines, &context->line_capacity, context->line_num, sizeof(Instruction));
+			Instruction* instruction = &context->lines[context->line_num++];
+			memset(instruction, 0, sizeof(Instruction));
+			instruction->opcode = values[0];
+			instruction->rd = values[1];
+			instruction->rs = values[2];
+			instruction->rt = values[3];
+			instruction->immediate = values[4];
+			instruction->label = values[5] >= 0 ? map[values[5]] : -1;
+			instruction->expr = values[6] >= 0 ? base_expr + values[6] : -1;
+			instruction->has_label = instruction->label >= 0 || instruction->expr >= 0;
+			instruction->line_number = values[7];
+			instruction->file = file_map[values[8]];
+			break;
+
+		case 'E':
+			if (read_fields(&cursor, values, 2) != 0 || (values[0] == EXPR_SYMBOL && (values[1] < 0 || values[1] >= symbol_num))) {
+				errors++;
+				break;
+			}
+			add_expr_token(context, values[0], values[0] == EXPR_SYMBOL ? map[values[1]] : values[1]);
+			break;
+
+		case 'W':
+			if (read_fields(&cursor, values, 5) != 0 || values[2] >= header[3] || values[4] < 0 || values[4] >= file_num) {
+				errors++;
+				break;
+			}
+			context->word_entries = grow_array(context->word_entries, &context->word_entries_capacity, context->word_entries_count, sizeof(WordEntry));
+			WordEntry* entry = &context->word_entries[context->word_entries_count++];
+			entry->address = values[0];
+			entry->data = values[1];
+			entry->expr = values[2] >= 0 ? base_expr + values[2] : -1;
+			entry->line_number = values[3];
+			entry->file = file_map[values[4]];
+			break;
+
+		case '\n':
+		case '\r':
+		case '\0':
+			break;
+
+		default:
+			errors++;
+			break;
+		}
+	}
+
+	if (errors == 0 && (symbol_num != header[1] || context->line_num - base_line != header[2] || context->expr_token_count - base_expr != header[3])) {
+		errors++;
+	}
+	if (errors != 0 && !reported) {
+		printf("Error: Corrupt object file '%s'.\n", filename);
+	}
+	free(map);
+	free(file_map);
+	free(source);
+	return errors ? -1 : 0;
+}
+
+// Adds a symbol record of an object file to the program symbols.
+// Returns the symbol index, -1 if the record is invalid or -2 if the symbol is already defined
+int link_symbol(const char* filename, char* text, SymbolTable* symbols, int base_line) {
+	char* cursor = text;
+	char* kind = take_token(&cursor);
+	int values[2];
+	int index;
+
+	if (kind == NULL || read_fields(&cursor, values, 2) != 0) {
+		return -1;
+	}
+	char* name = take_token(&cursor);
+	if (name == NULL) {
+		return -1;
+	}
+
+	// Imports and exports are found by name
+	if (kind[0] == 'U' || values[0]) {
+		index = symbols_intern(symbols, name);
+	}
+	else {
+		size_t length = strlen(filename) + strlen(name) + 2;
+		char* local_name = malloc(length);
+		if (local_name == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+		snprintf(local_name, length, "%s:%s", filename, name);
+		index = symbols_intern(symbols, local_name);
+		free(local_name);
+	}
+	if (kind[0] == 'U') {
+		return index;
+	}
+
+	Lable* lb = &symbols->labels[index];
+	if (lb->defined) {
+		printf("Error: Label '%s' defined in more than one module ('%s')\n", name, filename);
+		return -2;
+	}
+	lb->defined = 1;
+	lb->global = values[0];
+	lb->constant = kind[0] == 'C';
+	if (lb->constant) {
+		lb->position = values[1];
+	}
+	else {
+		lb->line_index = base_line + values[1];
+	}
+	return index;
+}
+
+// Reads count numbers separated by spaces. Returns 0 if all of them were found
+int read_fields(char** cursor, int values[], int count) {
+	for (int i = 0; i < count; i++) {
+		char* token = take_token(cursor);
+		if (token == NULL) {
+			return -1;
+		}
+		values[i] = (int)strtol(token, NULL, 10);
+	}
+	return 0;
+}
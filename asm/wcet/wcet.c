@@ -0,0 +1,757 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../asm/assembler.h"
+
+#define DISK_LATENCY 1024 // Cycles from a disk command until the disk is ready
+#define IO_DISKSTATUS 17
+#define UNBOUNDED -1LL // Cycle count of code without a bound
+#define NOT_VISITED -2LL
+#define VISITING -3LL
+
+// Straight line code, only the last instruction can jump
+typedef struct {
+	int first;				// Index of the first instruction
+	int last;				// Index of the last instruction
+	long long cycles;		// Cycles of the instructions
+	int succ[2];			// Next blocks in the function
+	int succ_num;
+	int call;				// Function called by the last instruction, -1 if none, -2 if unknown
+	int reads_diskstatus;	// The block polls the disk
+	int bound;				// .loop bound of the block, 0 if none
+} Block;
+
+// Code that is entered at one block: the program, a called function or an interrupt handler
+typedef struct {
+	int entry;				// Entry block
+	int handler;			// 1 if the code returns with reti
+	int state;				// 0 = not analyzed, 1 = being analyzed, 2 = done
+	long long wcet;			// Worst case cycles, UNBOUNDED if there is no bound
+} Function;
+
+// Control flow graph of the program and the results
+typedef struct {
+	AsmContext* context;
+	Block* blocks;
+	int block_num;
+	int* block_of;			// Block of each instruction
+	int* line_at;			// Instruction at each address, -1 if none
+	int address_num;
+	Function* functions;
+	int function_num;
+	int function_capacity;
+	const Lable** labels;	// Labels sorted by address
+	int label_num;
+	int* edge_head;			// Longest path scratch: first edge of each node, by block
+	int* edge_to;
+	int* edge_next;
+	long long* memo;
+} Analysis;
+
+// Function declarations
+int io_register(const Instruction* instruction);
+int branch_target(Analysis* a, int index);
+void format_address(const Analysis* a, int address, char* buffer, size_t size);
+void check_bigimm(const Analysis* a);
+void build_blocks(Analysis* a, const int* entries, int entry_num);
+int add_function(Analysis* a, int block);
+int reaches_reti(const Analysis* a, int entry);
+long long analyze_function(Analysis* a, int index);
+int loop_body(const Analysis* a, const int* nodes, int node_num, const int* latches, int latch_num, int header, char* region, int* body);
+long long longest_path(Analysis* a, const int* nodes, int node_num, const char* in_region, const int* rep, const long long* cost, int head);
+long long longest_from(Analysis* a, int node, const long long* cost);
+
+int main(int argc, char* argv[])
+{
+	AsmContext context;
+	Analysis a;
+	const char* input = NULL;
+	int optimize = 0;
+	int* entries;
+	int entry_num = 0;
+
+	entries = malloc(((size_t)argc + 1) * sizeof(int));
+	if (entries == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	// Get the options, the source is the other argument
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-O") == 0) {
+			optimize = 1;
+		}
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+			i++;
+		}
+		else if (argv[i][0] != '-' && input == NULL) {
+			input = argv[i];
+		}
+		else {
+			input = NULL;
+			break;
+		}
+	}
+
+	// validate number of arguments
+	if (input == NULL) {
+		printf("Usage: %s [-O] [-e <label>] ... <input_file>\n", argv[0]);
+		printf("Prints the static cycle count of every block and the worst case cycles of the program, its functions and\n");
+		printf("interrupt handlers. Loops need a bound: put .loop N before the first instruction of the loop.\n");
+		printf("-e analyzes the code at the label as one more function\n");
+		free(entries);
+		return 1;
+	}
+
+	// Assemble and lay out the program like the asm program does
+	char* source = read_source(input);
+	if (source == NULL) {
+		printf("Error: Could not open input file '%s'.\n", input);
+		free(entries);
+		return 1;
+	}
+	context_init(&context);
+	int result = parse_source(&context, source, input);
+	free(source);
+	if (result >= 0 && check_symbols(&context) != 0) {
+		result = -1;
+	}
+	if (result < 0) {
+		context_free(&context);
+		free(entries);
+		return 1;
+	}
+	if (optimize) {
+		optimize_program(&context);
+	}
+	memset(&a, 0, sizeof(Analysis));
+	a.context = &context;
+	a.address_num = Get_labels(&context);
+	for (int i = 0; i < context.line_num; i++) {
+		if (context.lines[i].has_label) {
+			context.lines[i].immediate = resolve_immediate(&context, &context.lines[i]);
+		}
+	}
+
+	// Instruction of every address and labels by address
+	a.line_at = malloc(((size_t)a.address_num + 1) * sizeof(int));
+	a.labels = malloc(((size_t)context.symbols.label_num + 1) * sizeof(Lable*));
+	if (a.line_at == NULL || a.labels == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	for (int i = 0; i < a.address_num; i++) {
+		a.line_at[i] = -1;
+	}
+	for (int i = 0; i < context.line_num; i++) {
+		a.line_at[context.lines[i].address] = i;
+	}
+	for (int i = 0; i < context.symbols.label_num; i++) {
+		if (context.symbols.labels[i].defined && !context.symbols.labels[i].constant) {
+			a.labels[a.label_num++] = &context.symbols.labels[i];
+		}
+	}
+	qsort(a.labels, (size_t)a.label_num, sizeof(Lable*), compare_map_labels);
+
+	// Entries given on the command line
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-e") == 0) {
+			int label = symbols_find(&context.symbols, argv[++i]);
+			if (label < 0 || !context.symbols.labels[label].defined || context.symbols.labels[label].constant ||
+				context.symbols.labels[label].line_index >= context.line_num) {
+				printf("Error: Unknown entry label '%s'\n", argv[i]);
+				continue;
+			}
+			entries[entry_num++] = context.symbols.labels[label].line_index;
+		}
+	}
+
+	if (context.line_num > 0) {
+		check_bigimm(&a);
+		build_blocks(&a, entries, entry_num);
+
+		// Cycles of every block
+		char location[256];
+		printf("Blocks:\n");
+		for (int i = 0; i < a.block_num; i++) {
+			const Block* block = &a.blocks[i];
+			format_address(&a, context.lines[block->first].address, location, sizeof(location));
+			printf("  %03X-%03X %-40s %lld cycles\n", context.lines[block->first].address, context.lines[block->last].address, location, block->cycles);
+		}
+
+		// Worst case of every function, the loops are printed while they are analyzed
+		printf("Loops:\n");
+		for (int i = 0; i < a.function_num; i++) {
+			analyze_function(&a, i);
+		}
+		printf("Functions:\n");
+		for (int i = 0; i < a.function_num; i++) {
+			const Function* function = &a.functions[i];
+			format_address(&a, context.lines[a.blocks[function->entry].first].address, location, sizeof(location));
+			if (function->wcet == UNBOUNDED) {
+				printf("  %03X %-40s unbounded%s\n", context.lines[a.blocks[function->entry].first].address, location, function->handler ? " (interrupt handler)" : "");
+			}
+			else {
+				printf("  %03X %-40s %lld cycles%s\n", context.lines[a.blocks[function->entry].first].address, location, function->wcet, function->handler ? " (interrupt handler)" : "");
+			}
+		}
+
+		// The program starts at address 0, interrupts are not included
+		if (a.functions[0].wcet == UNBOUNDED) {
+			printf("Program WCET: unbounded\n");
+		}
+		else {
+			printf("Program WCET: %lld cycles\n", a.functions[0].wcet);
+		}
+	}
+
+	free(a.blocks);
+	free(a.block_of);
+	free(a.line_at);
+	free(a.functions);
+	free((void*)a.labels);
+	free(a.edge_head);
+	free(a.edge_to);
+	free(a.edge_next);
+	free(a.memo);
+	free(entries);
+	context_free(&context);
+	return 0;
+}
+
+// Returns the IO register of an in or out instruction, -1 if it depends on a register value
+int io_register(const Instruction* instruction) {
+	int value = 0;
+	if (instruction->rs == REG_IMM) {
+		value += instruction->immediate;
+	}
+	else if (instruction->rs != REG_ZERO) {
+		return -1;
+	}
+	if (instruction->rt == REG_IMM) {
+		value += instruction->immediate;
+	}
+	else if (instruction->rt != REG_ZERO) {
+		return -1;
+	}
+	return value;
+}
+
+// Returns the instruction a branch or call jumps to, -1 if the target is not an instruction
+int branch_target(Analysis* a, int index) {
+	const Instruction* line = &a->context->lines[index];
+	int address = line->immediate;
+	if (address < 0 || address >= a->address_num || a->line_at[address] < 0) {
+		char location[256];
+		format_address(a, line->address, location, sizeof(location));
+		printf("Warning: Jump to address %03X that is not an instruction at %s\n", address, location);
+		return -1;
+	}
+	return a->line_at[address];
+}
+
+// Writes "label+offset file:line" for the address of an instruction
+void format_address(const Analysis* a, int address, char* buffer, size_t size) {
+	int low = 0;
+	int high = a->label_num;
+	int length = 0;
+
+	// First label after the address
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (a->labels[middle]->position <= address) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	buffer[0] = '\0';
+	if (low > 0) {
+		const Lable* lb = a->labels[low - 1];
+		const char* name = symbols_name(&a->context->symbols, (int)(lb - a->context->symbols.labels));
+		length = lb->position == address ? snprintf(buffer, size, "%s", name) : snprintf(buffer, size, "%s+%d", name, address - lb->position);
+	}
+	if (length < 0 || (size_t)length >= size) {
+		return;
+	}
+	if (address >= 0 && address < a->address_num && a->line_at[address] >= 0) {
+		const Instruction* line = &a->context->lines[a->line_at[address]];
+		snprintf(buffer + length, size - (size_t)length, "%s%s:%d", length ? " " : "", a->context->files[line->file], line->line_number);
+	}
+}
+
+// Reports instructions that take the extra bigimm cycle for nothing: the immediate is not used,
+// or an expression with labels ended up with a value that fits in 8 bits
+void check_bigimm(const Analysis* a) {
+	const AsmContext* context = a->context;
+	char location[256];
+
+	for (int i = 0; i < context->line_num; i++) {
+		const Instruction* line = &context->lines[i];
+		if (!line->is_bigimm) {
+			continue;
+		}
+		format_address(a, line->address, location, sizeof(location));
+		if (!reads_register(line, REG_IMM)) {
+			printf("Warning: bigimm is not needed at %03X %s: $imm is not used\n", line->address, location);
+		}
+		else if (line->has_label && line->immediate >= -128 && line->immediate <= 127) {
+			printf("Warning: bigimm is not needed at %03X %s: the label value %d fits in 8 bits\n", line->address, location, line->immediate);
+		}
+	}
+}
+
+// Splits the program into blocks and finds their successors. Every call target, every entry and
+// every label whose address is used as a value and leads to reti starts a function
+void build_blocks(Analysis* a, const int* entries, int entry_num) {
+	AsmContext* context = a->context;
+	const Instruction* lines = context->lines;
+	int line_num = context->line_num;
+	char* leader = calloc((size_t)line_num + 1, 1);
+	int* targets = malloc(((size_t)line_num + 1) * sizeof(int));
+	int* handlers = malloc(((size_t)line_num + 1) * sizeof(int));
+	int handler_num = 0;
+	a->block_of = malloc(((size_t)line_num + 1) * sizeof(int));
+	if (leader == NULL || targets == NULL || handlers == NULL || a->block_of == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	// A block starts at the entries, at jump targets and after jumps
+	leader[0] = 1;
+	for (int i = 0; i < entry_num; i++) {
+		leader[entries[i]] = 1;
+	}
+	for (int i = 0; i < line_num; i++) {
+		const Instruction* line = &lines[i];
+		targets[i] = -1;
+		if ((line->opcode >= OP_BEQ && line->opcode <= OP_BGE && line->rd == REG_IMM) || (line->opcode == OP_JAL && line->rs == REG_IMM)) {
+			targets[i] = branch_target(a, i);
+			if (targets[i] >= 0) {
+				leader[targets[i]] = 1;
+			}
+		}
+		if ((line->opcode >= OP_BEQ && line->opcode <= OP_JAL) || line->opcode == OP_RETI || line->opcode == OP_HALT) {
+			leader[i + 1] = 1;
+		}
+
+		// Labels whose address is used as a value may be interrupt handlers
+		int is_branch = line->opcode >= OP_BEQ && line->opcode <= OP_BGE && line->rd == REG_IMM && line->rs != REG_IMM && line->rt != REG_IMM;
+		int is_call = line->opcode == OP_JAL && line->rs == REG_IMM;
+		if (line->label >= 0 && !is_branch && !is_call) {
+			const Lable* lb = &context->symbols.labels[line->label];
+			if (lb->defined && !lb->constant && lb->line_index < line_num) {
+				leader[lb->line_index] = 1;
+				handlers[handler_num++] = lb->line_index;
+			}
+		}
+	}
+
+	// Block of every instruction and the cycles of the blocks
+	a->blocks = malloc(((size_t)line_num + 1) * sizeof(Block));
+	if (a->blocks == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	for (int i = 0; i < line_num; i++) {
+		if (leader[i]) {
+			Block* block = &a->blocks[a->block_num++];
+			memset(block, 0, sizeof(Block));
+			block->first = i;
+			block->call = -1;
+		}
+		Block* block = &a->blocks[a->block_num - 1];
+		block->last = i;
+		block->cycles += lines[i].is_bigimm ? 2 : 1;
+		if (lines[i].opcode == OP_IN && io_register(&lines[i]) == IO_DISKSTATUS) {
+			block->reads_diskstatus = 1;
+		}
+		a->block_of[i] = a->block_num - 1;
+	}
+	for (int i = 0; i < context->loop_bound_count; i++) {
+		if (context->loop_bounds[i].line_index < line_num) {
+			a->blocks[a->block_of[context->loop_bounds[i].line_index]].bound = context->loop_bounds[i].bound;
+		}
+	}
+
+	// The program is the first function
+	add_function(a, 0);
+	for (int i = 0; i < entry_num; i++) {
+		add_function(a, a->block_of[entries[i]]);
+	}
+
+	// Successors of the blocks. Indirect jumps leave the function, through $ra they are returns
+	char location[256];
+	for (int i = 0; i < a->block_num; i++) {
+		Block* block = &a->blocks[i];
+		const Instruction* line = &lines[block->last];
+		int next = block->last + 1 < line_num ? a->block_of[block->last + 1] : -1;
+		int taken = 1;
+		int falls = 1;
+
+		if (line->opcode >= OP_BEQ && line->opcode <= OP_BGE) {
+			// Comparing a register to itself is always or never true
+			if (line->rs == line->rt) {
+				taken = line->opcode == OP_BEQ || line->opcode == OP_BLE || line->opcode == OP_BGE;
+				falls = !taken;
+			}
+			if (taken && line->rd == REG_IMM && targets[block->last] >= 0) {
+				block->succ[block->succ_num++] = a->block_of[targets[block->last]];
+			}
+			else if (taken && line->rd != REG_IMM && line->rd != REG_RA) {
+				format_address(a, line->address, location, sizeof(location));
+				printf("Warning: Jump through a register at %03X %s is taken as a return\n", line->address, location);
+			}
+		}
+		else if (line->opcode == OP_JAL) {
+			if (line->rs == REG_IMM && targets[block->last] >= 0) {
+				block->call = add_function(a, a->block_of[targets[block->last]]);
+			}
+			else {
+				format_address(a, line->address, location, sizeof(location));
+				printf("Warning: Call through a register at %03X %s has no bound\n", line->address, location);
+				block->call = -2;
+			}
+		}
+		else if (line->opcode == OP_RETI || line->opcode == OP_HALT) {
+			falls = 0;
+		}
+		if (falls && next >= 0 && (block->succ_num == 0 || block->succ[0] != next)) {
+			block->succ[block->succ_num++] = next;
+		}
+	}
+
+	// Interrupt handlers are found by their address being used as a value
+	for (int i = 0; i < handler_num; i++) {
+		if (reaches_reti(a, a->block_of[handlers[i]])) {
+			add_function(a, a->block_of[handlers[i]]);
+		}
+	}
+	for (int i = 0; i < a->function_num; i++) {
+		a->functions[i].handler = reaches_reti(a, a->functions[i].entry);
+	}
+
+	free(leader);
+	free(targets);
+	free(handlers);
+}
+
+// Adds a function that starts at the block, if it is not known yet. Returns its index
+int add_function(Analysis* a, int block) {
+	for (int i = 0; i < a->function_num; i++) {
+		if (a->functions[i].entry == block) {
+			return i;
+		}
+	}
+	a->functions = grow_array(a->functions, &a->function_capacity, a->function_num, sizeof(Function));
+	Function* function = &a->functions[a->function_num];
+	memset(function, 0, sizeof(Function));
+	function->entry = block;
+	function->wcet = UNBOUNDED;
+	return a->function_num++;
+}
+
+// Checks if reti can be reached from the block without calls
+int reaches_reti(const Analysis* a, int entry) {
+	char* seen = calloc((size_t)a->block_num + 1, 1);
+	int* stack = malloc(((size_t)a->block_num + 1) * sizeof(int));
+	int depth = 0;
+	int found = 0;
+	if (seen == NULL || stack == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	stack[depth++] = entry;
+	seen[entry] = 1;
+	while (depth > 0 && !found) {
+		const Block* block = &a->blocks[stack[--depth]];
+		found = a->context->lines[block->last].opcode == OP_RETI;
+		for (int i = 0; i < block->succ_num; i++) {
+			if (!seen[block->succ[i]]) {
+				seen[block->succ[i]] = 1;
+				stack[depth++] = block->succ[i];
+			}
+		}
+	}
+	free(seen);
+	free(stack);
+	return found;
+}
+
+// Finds the worst case cycles of a function. Loops are found by their back edges and collapsed from the
+// innermost out: a loop costs its bound times its longest iteration. A loop that polls the disk status
+// and has no .loop bound waits at most the disk latency. Calls add the worst case of the function called
+long long analyze_function(Analysis* a, int index) {
+	Function* function = &a->functions[index];
+	int block_num = a->block_num;
+	char location[256];
+
+	if (function->state == 2) {
+		return function->wcet;
+	}
+	format_address(a, a->context->lines[a->blocks[function->entry].first].address, location, sizeof(location));
+	if (function->state == 1) {
+		printf("Warning: Recursive call of %s has no bound\n", location);
+		return UNBOUNDED;
+	}
+	function->state = 1;
+
+	char* in_function = calloc((size_t)block_num + 1, 1);
+	char* in_loop = calloc((size_t)block_num + 1, 1);
+	int* order = malloc(((size_t)block_num + 1) * sizeof(int));
+	int* next_succ = calloc((size_t)block_num + 1, sizeof(int));
+	char* on_stack = calloc((size_t)block_num + 1, 1);
+	int* stack = malloc(((size_t)block_num + 1) * sizeof(int));
+	int* headers = malloc(((size_t)block_num + 1) * sizeof(int));
+	int* latches = malloc(((size_t)block_num * 2 + 1) * sizeof(int));
+	int* body = malloc(((size_t)block_num + 1) * sizeof(int));
+	int* rep = malloc(((size_t)block_num + 1) * sizeof(int));
+	long long* cost = malloc(((size_t)block_num + 1) * sizeof(long long));
+	if (!in_function || !in_loop || !order || !next_succ || !on_stack || !stack || !headers || !latches || !body || !rep || !cost) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+
+	// Depth first search from the entry. An edge to a block on the stack is a back edge of a loop
+	int node_num = 0;
+	int header_num = 0;
+	int latch_num = 0;
+	int depth = 0;
+	stack[depth++] = function->entry;
+	in_function[function->entry] = 1;
+	on_stack[function->entry] = 1;
+	order[node_num++] = function->entry;
+	while (depth > 0) {
+		int node = stack[depth - 1];
+		if (next_succ[node] == a->blocks[node].succ_num) {
+			on_stack[node] = 0;
+			depth--;
+			continue;
+		}
+		int succ = a->blocks[node].succ[next_succ[node]++];
+		if (on_stack[succ]) {
+			latches[latch_num++] = node;
+			latches[latch_num++] = succ;
+			if (!in_loop[succ]) {
+				in_loop[succ] = 1;
+				headers[header_num++] = succ;
+			}
+		}
+		else if (!in_function[succ]) {
+			in_function[succ] = 1;
+			on_stack[succ] = 1;
+			order[node_num++] = succ;
+			stack[depth++] = succ;
+		}
+	}
+
+	// Block costs with the calls
+	long long wcet = 0;
+	for (int i = 0; i < node_num; i++) {
+		const Block* block = &a->blocks[order[i]];
+		rep[order[i]] = order[i];
+		cost[order[i]] = block->cycles;
+		if (block->call == -2) {
+			cost[order[i]] = UNBOUNDED;
+		}
+		else if (block->call >= 0) {
+			long long callee = analyze_function(a, block->call);
+			cost[order[i]] = callee == UNBOUNDED ? UNBOUNDED : cost[order[i]] + callee;
+		}
+	}
+
+	// Inner loops have smaller bodies, so sort the loops by body size
+	int* sizes = calloc((size_t)block_num + 1, sizeof(int));
+	char* region = calloc((size_t)block_num + 1, 1);
+	if (sizes == NULL || region == NULL) {
+		printf("Error: Out of memory\n");
+		exit(1);
+	}
+	for (int i = 0; i < header_num; i++) {
+		int header = headers[i];
+		sizes[header] = loop_body(a, order, node_num, latches, latch_num, header, region, body);
+	}
+	for (int i = 1; i < header_num; i++) {
+		int header = headers[i];
+		int j = i;
+		for (; j > 0 && sizes[headers[j - 1]] > sizes[header]; j--) {
+			headers[j] = headers[j - 1];
+		}
+		headers[j] = header;
+	}
+
+	for (int i = 0; i < header_num; i++) {
+		int header = headers[i];
+		int body_num = loop_body(a, order, node_num, latches, latch_num, header, region, body);
+
+		// A loop that is entered in the middle has no single header
+		int irreducible = 0;
+		int polls_disk = 0;
+		int bound = a->blocks[header].bound;
+		for (int j = 0; j < body_num; j++) {
+			polls_disk |= a->blocks[body[j]].reads_diskstatus;
+		}
+		for (int k = 0; k < node_num; k++) {
+			const Block* block = &a->blocks[order[k]];
+			for (int s = 0; s < block->succ_num; s++) {
+				if (!region[order[k]] && region[block->succ[s]] && block->succ[s] != header) {
+					irreducible = 1;
+				}
+			}
+		}
+
+		format_address(a, a->context->lines[a->blocks[header].first].address, location, sizeof(location));
+		long long iteration = irreducible ? UNBOUNDED : longest_path(a, body, body_num, region, rep, cost, header);
+		long long total = UNBOUNDED;
+		if (irreducible) {
+			printf("Warning: Loop at %s is entered in the middle and has no bound\n", location);
+		}
+		else if (iteration == UNBOUNDED) {
+			total = UNBOUNDED;
+		}
+		else if (bound > 0) {
+			total = iteration * bound;
+			printf("  loop %03X %-35s bound %d, %lld cycles per iteration, %lld cycles\n", a->context->lines[a->blocks[header].first].address, location, bound, iteration, total);
+		}
+		else if (polls_disk) {
+			total = DISK_LATENCY + iteration;
+			printf("  loop %03X %-35s disk wait, %lld cycles per iteration, %lld cycles\n", a->context->lines[a->blocks[header].first].address, location, iteration, total);
+		}
+		else {
+			printf("Warning: Loop at %s has no .loop bound\n", location);
+		}
+
+		// The loop becomes one node at its header
+		for (int j = 0; j < body_num; j++) {
+			rep[body[j]] = header;
+		}
+		cost[header] = total;
+	}
+
+	memset(region, 0, (size_t)block_num);
+	for (int i = 0; i < node_num; i++) {
+		region[order[i]] = 1;
+	}
+	wcet = longest_path(a, order, node_num, region, rep, cost, rep[function->entry]);
+
+	free(in_function);
+	free(in_loop);
+	free(order);
+	free(next_succ);
+	free(on_stack);
+	free(stack);
+	free(headers);
+	free(latches);
+	free(body);
+	free(rep);
+	free(cost);
+	free(sizes);
+	free(region);
+
+	function->wcet = wcet;
+	function->state = 2;
+	return wcet;
+}
+
+// Finds the blocks of the loop with the header: the header and the blocks that reach one of its
+// back edges without going through the header. Marks them in region. Returns the number of blocks
+int loop_body(const Analysis* a, const int* nodes, int node_num, const int* latches, int latch_num, int header, char* region, int* body) {
+	int body_num = 0;
+
+	memset(region, 0, (size_t)a->block_num);
+	region[header] = 1;
+	body[body_num++] = header;
+	for (int i = 0; i < latch_num; i += 2) {
+		if (latches[i + 1] == header && !region[latches[i]]) {
+			region[latches[i]] = 1;
+			body[body_num++] = latches[i];
+		}
+	}
+
+	// Go back from the latches over the predecessors
+	for (int i = 1; i < body_num; i++) {
+		for (int j = 0; j < node_num; j++) {
+			const Block* block = &a->blocks[nodes[j]];
+			for (int s = 0; s < block->succ_num; s++) {
+				if (block->succ[s] == body[i] && !region[nodes[j]]) {
+					region[nodes[j]] = 1;
+					body[body_num++] = nodes[j];
+				}
+			}
+		}
+	}
+	return body_num;
+}
+
+// Longest path from the head over the blocks of a region, where the blocks of a collapsed loop are one node.
+// Edges back to the head are left out. Returns UNBOUNDED if a node on the path has no bound
+long long longest_path(Analysis* a, const int* nodes, int node_num, const char* in_region, const int* rep, const long long* cost, int head) {
+	int edge_num = 0;
+
+	if (a->edge_head == NULL) {
+		a->edge_head = malloc(((size_t)a->block_num + 1) * sizeof(int));
+		a->edge_to = malloc(((size_t)a->block_num * 2 + 1) * sizeof(int));
+		a->edge_next = malloc(((size_t)a->block_num * 2 + 1) * sizeof(int));
+		a->memo = malloc(((size_t)a->block_num + 1) * sizeof(long long));
+		if (a->edge_head == NULL || a->edge_to == NULL || a->edge_next == NULL || a->memo == NULL) {
+			printf("Error: Out of memory\n");
+			exit(1);
+		}
+	}
+
+	// Edges between the nodes of the region
+	for (int i = 0; i < node_num; i++) {
+		a->edge_head[rep[nodes[i]]] = -1;
+		a->memo[rep[nodes[i]]] = NOT_VISITED;
+	}
+	for (int i = 0; i < node_num; i++) {
+		const Block* block = &a->blocks[nodes[i]];
+		int from = rep[nodes[i]];
+		for (int s = 0; s < block->succ_num; s++) {
+			if (!in_region[block->succ[s]]) {
+				continue;
+			}
+			int to = rep[block->succ[s]];
+			if (to != from && to != head) {
+				a->edge_to[edge_num] = to;
+				a->edge_next[edge_num] = a->edge_head[from];
+				a->edge_head[from] = edge_num++;
+			}
+		}
+	}
+	return longest_from(a, head, cost);
+}
+
+// Longest path from a node of the current region, memoized
+long long longest_from(Analysis* a, int node, const long long* cost) {
+	if (a->memo[node] == VISITING) {
+		return UNBOUNDED;
+	}
+	if (a->memo[node] != NOT_VISITED) {
+		return a->memo[node];
+	}
+	if (cost[node] == UNBOUNDED) {
+		a->memo[node] = UNBOUNDED;
+		return UNBOUNDED;
+	}
+
+	a->memo[node] = VISITING;
+	long long longest = 0;
+	for (int e = a->edge_head[node]; e >= 0; e = a->edge_next[e]) {
+		long long path = longest_from(a, a->edge_to[e], cost);
+		if (path == UNBOUNDED) {
+			longest = UNBOUNDED;
+			break;
+		}
+		if (path > longest) {
+			longest = path;
+		}
+	}
+	a->memo[node] = longest == UNBOUNDED ? UNBOUNDED : cost[node] + longest;
+	return a->memo[node];
+}
@@ -1,5 +1,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "data.h"
+#include "diskio.h"
+#include "../../asm/asm/simp_asm.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -9,36 +11,157 @@
 
 // Initialize all memory lines to 0
 void memory_init(Memory* memory) {
-    for (int i = 0; i < DATA_MEM_DEPTH; i++) {
-        memory->data[i] = 0;
+    memory_init_width(memory, DEFAULT_ADDRESS_BITS);
+}
+
+// Initialize a memory of 1 << address_bits words. No page is allocated yet
+void memory_init_width(Memory* memory, int address_bits) {
+    int page_count = (1 << address_bits) / PAGE_WORDS;
+
+    memory->address_bits = address_bits;
+    memory->depth = 1 << address_bits;
+    memory->directory_size = (page_count + TABLE_SIZE - 1) / TABLE_SIZE;
+    memory->directory = calloc((size_t)memory->directory_size, sizeof(int32_t**));
+    memory->page_num = 0;
+    memory->shared = 0;
+    memory->pending = NULL;
+    if (!memory->directory) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < MEMORY_TLB_SIZE; i++) {
+        memory->tlb[i].page = -1;
+        memory->tlb[i].words = NULL;
+    }
+}
+
+// Frees the pages of a memory
+void memory_free(Memory* memory) {
+    for (int i = 0; i < memory->directory_size; i++) {
+        if (!memory->directory[i]) {
+            continue;
+        }
+        for (int j = 0; j < TABLE_SIZE; j++) {
+            free(memory->directory[i][j]);
+        }
+        free(memory->directory[i]);
+    }
+    free(memory->directory);
+    memory->directory = NULL;
+    memory->directory_size = 0;
+    memory->page_num = 0;
+}
+
+// Finds a page in the page tables, NULL if it was never written
+int32_t* memory_page(const Memory* memory, int page) {
+    int32_t** table = memory->directory[page >> TABLE_BITS];
+    return table ? table[page & (TABLE_SIZE - 1)] : NULL;
+}
+
+// Finds a page and allocates it if it was never written
+static int32_t* allocate_page(Memory* memory, int page) {
+    int32_t*** table = &memory->directory[page >> TABLE_BITS];
+    if (!*table) {
+        *table = calloc(TABLE_SIZE, sizeof(int32_t*));
+    }
+    if (!*table) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    int32_t** words = &(*table)[page & (TABLE_SIZE - 1)];
+    if (!*words) {
+        *words = calloc(PAGE_WORDS, sizeof(int32_t));
+        if (!*words) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+        memory->page_num++;
+    }
+    return *words;
+}
+
+// Finds the page of an address through the TLB. A page that was never written is allocated when allocate is 1,
+// otherwise it is NULL
+static int32_t* tlb_page(Memory* memory, int page, int allocate) {
+    if (memory->shared) {
+        return memory_page(memory, page);
+    }
+    MemoryTlbEntry* entry = &memory->tlb[page & (MEMORY_TLB_SIZE - 1)];
+    if (entry->page == page) {
+        return entry->words;
+    }
+    int32_t* words = allocate ? allocate_page(memory, page) : memory_page(memory, page);
+    if (words) {
+        entry->page = page;
+        entry->words = words;
+    }
+    return words;
+}
+
+// Copies the words of a memory to another one of the same width
+void memory_copy(Memory* to, const Memory* from) {
+    int page_count = to->directory_size * TABLE_SIZE;
+
+    for (int page = 0; page < page_count; page++) {
+        const int32_t* words = memory_page(from, page);
+        if (words) {
+            memcpy(allocate_page(to, page), words, PAGE_WORDS * sizeof(int32_t));
+        }
+        else if (memory_page(to, page)) {
+            free(to->directory[page >> TABLE_BITS][page & (TABLE_SIZE - 1)]);
+            to->directory[page >> TABLE_BITS][page & (TABLE_SIZE - 1)] = NULL;
+            to->page_num--;
+        }
+    }
+    for (int i = 0; i < MEMORY_TLB_SIZE; i++) {
+        to->tlb[i].page = -1;
     }
 }
 
+// Allocates every page, the cores of a multi-core run never change the page tables
+void memory_share(Memory* memory) {
+    for (int page = 0; page < memory->depth / PAGE_WORDS; page++) {
+        allocate_page(memory, page);
+    }
+    memory->shared = 1;
+}
+
 // loads instruction from memory file
 void load_instruction(const char* filename, Memory* memory) {
-    FILE* file = fopen(filename, "r");
-    if (file) {
-        char line[9];
-        int address = 0;
-        // while there are more lines
-        while (address < DATA_MEM_DEPTH && fgets(line, sizeof(line), file)) {
-            line[strcspn(line, "\r\n")] = '\0';
-            // check if line in valid
-            if (strlen(line) != 8) continue;
-            memory->data[address] = (int32_t)strtoll(line, NULL, 16);
-            address += 1;
+    // The format of the file (dense, sparse text or sparse binary) is found by the reader
+    // One more word than the memory to find images that do not fit
+    int* words = malloc(((size_t)memory->depth + 1) * sizeof(int));
+    if (!words) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    int word_num = read_image_file(filename, words, memory->depth + 1);
+    if (word_num > memory->depth) {
+        printf("Warning: '%s' has words past the %d words of memory, they are not loaded. Use -addrbits for a larger memory\n",
+            filename, memory->depth);
+    }
+    if (word_num > 0) {
+        load_words(memory, words, word_num);
+    }
+    free(words);
+}
+
+// Load memory words that are already in memory, e.g. from the assembler
+void load_words(Memory* memory, const int* words, int word_num) {
+    for (int address = 0; address < word_num && address < memory->depth; address++) {
+        // Zero words leave their page unallocated
+        if (words[address] != 0 || read_data_from_memory(memory, address) != 0) {
+            write_data_to_memory(memory, address, (int32_t)words[address]);
         }
-        fclose(file);
     }
 }
 
-// Read an instruction from memory
-const int8_t* read_instruction_from_memory(const Memory* memory, int address) {
-    static int8_t instr[4];
+// Read an instruction from memory into the caller's buffer, the cores of a multi-core run read at the same time
+const int8_t* read_instruction_from_memory(const Memory* memory, int address, int8_t instr[4]) {
     // Check if address is out of bounds
-    if (address >= DATA_MEM_DEPTH || address < 0) { return NULL; }
+    if (address >= memory->depth || address < 0) { return NULL; }
     else {
-        int32_t word = memory->data[address];
+        int32_t word = read_data_from_memory(memory, address);
         instr[0] = (word >> 24) & 0xFF;
         instr[1] = (word >> 16) & 0xFF;
         instr[2] = (word >> 8) & 0xFF;
@@ -47,38 +170,54 @@ const int8_t* read_instruction_from_memory(const Memory* memory, int address) {
     }
 }
 
-// Write to Memory out file
-void write_memory_out(const char* filename, const Memory* memory) {
+// Write to Memory out file, in the dense format or one of the sparse image formats. Pages that were
+// never written are zeros in the dense format and are skipped by the sparse ones
+void write_memory_out(const char* filename, const Memory* memory, int format) {
+    int page_count = memory->depth / PAGE_WORDS;
+    const int** pages = malloc((size_t)page_count * sizeof(int*));
+    if (!pages) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
     // Find the last non-zero entry in the data memory
     int last_non_zero_index = -1;
-    // Go over Data until last non zero
-    for (int i = 0; i < DATA_MEM_DEPTH; i++) {
-        if (memory->data[i] != 0) {
-            last_non_zero_index = i;
-        }
-    }
-    FILE* file = fopen(filename, "w");
-    // check validity of file
-    if (file)
-    {
-        // write to file until last non zero index
-        for (int i = 0; i <= last_non_zero_index; i++) {
-            fprintf(file, "%08X\n", memory->data[i]);
+    for (int page = 0; page < page_count; page++) {
+        const int32_t* words = memory_page(memory, page);
+        pages[page] = (const int*)words;
+        for (int i = 0; words && i < PAGE_WORDS; i++) {
+            if (words[i] != 0) {
+                last_non_zero_index = page * PAGE_WORDS + i;
+            }
         }
-        fclose(file);
     }
+    write_paged_image_file(filename, pages, PAGE_WORDS, last_non_zero_index + 1, format);
+    free(pages);
 }
 
 // Write a word to memory
 void write_data_to_memory(Memory* memory, int address, int32_t value) {
-    if (address >= DATA_MEM_DEPTH || address < 0) { return; }
-    else { memory->data[address] = value; }
+    if (address >= memory->depth || address < 0) { return; }
+    // The words of a disk read come first
+    if (memory->pending && disk_io_in_buffer(memory->pending, address)) { disk_io_complete(memory); }
+    tlb_page(memory, address >> PAGE_BITS, 1)[address & (PAGE_WORDS - 1)] = value;
 }
 
 // Read a word from memory
 int32_t read_data_from_memory(const Memory* memory, int address) {
-    if (address >= DATA_MEM_DEPTH || address < 0) { return 0; }
-    else { return memory->data[address]; }
+    if (address >= memory->depth || address < 0) { return 0; }
+    // A word of a disk read that is not in memory yet
+    int32_t word;
+    if (memory->pending && disk_io_in_buffer(memory->pending, address) && disk_io_word(memory->pending, address, &word)) { return word; }
+    const int32_t* words = memory_page(memory, address >> PAGE_BITS);
+    return words ? words[address & (PAGE_WORDS - 1)] : 0;
+}
+
+// lw: reads a word through the TLB
+int32_t memory_load(Memory* memory, int address) {
+    if (address >= memory->depth || address < 0) { return 0; }
+    if (memory->pending && disk_io_in_buffer(memory->pending, address)) { disk_io_complete(memory); }
+    const int32_t* words = tlb_page(memory, address >> PAGE_BITS, 0);
+    return words ? words[address & (PAGE_WORDS - 1)] : 0;
 }
 
 
@@ -161,7 +300,7 @@ char* io_names_for_output(int reg) {
     case 17:
         return "diskstatus";
     case 18:
-        return "reserved1";
+        return "coreid";
     case 19:
         return "reserved2";
     case 20:
@@ -175,10 +314,17 @@ char* io_names_for_output(int reg) {
     }
 }
 
+// The disk and the monitor are shared by the cores, their registers are in the IO registers of core 0
+int is_device_register(int reg) {
+    return (reg >= DISKCMD && reg <= DISKSTATUS) || (reg >= MONITORADDR && reg <= MONITORCMD);
+}
+
 // Initialize all io registers to 0 and Halt to 1
 void io_init(IORegisters* io_registers) {
     memset(io_registers->IORegistersArray, 0, sizeof(io_registers->IORegistersArray));
     io_registers->halt = 1;
+    io_registers->address_bits = DEFAULT_ADDRESS_BITS;
+    io_registers->devices = NULL;
 }
 
 // Read value from an io register
@@ -186,7 +332,8 @@ int32_t read_from_io(const IORegisters* io_registers, int reg, FILE* hwregtrace_
     // if index is in bounds
     if (reg < NUM_IO_REGISTERS && reg > 0)
     {
-        int32_t register_value = io_registers->IORegistersArray[reg];
+        const IORegisters* owner = (io_registers->devices && is_device_register(reg)) ? io_registers->devices : io_registers;
+        int32_t register_value = owner->IORegistersArray[reg];
 
         // check if file is valid
         if (hwregtrace_file) {
@@ -203,11 +350,15 @@ void write_to_io(IORegisters* io_registers, int reg, int32_t value, FILE* hwregt
     // if index is in bounds
     if (reg < NUM_IO_REGISTERS && reg > 0)
     {
+        IORegisters* owner = (io_registers->devices && is_device_register(reg)) ? io_registers->devices : io_registers;
         int bit_width = IO_REGISTER_SIZES[reg];
-        // apply mask to limit the value
-        if (bit_width > 0) {
+        if (reg == IRQHANDLER || reg == IRQRETURN || reg == DISKBUFFER) {
+            bit_width = io_registers->address_bits;
+        }
+        // apply mask to limit the value, coreid is read only
+        if (bit_width > 0 && reg != COREID) {
             int32_t mask = (bit_width == 32) ? 0xFFFFFFFF : (1U << bit_width) - 1;
-            io_registers->IORegistersArray[reg] = value & mask;
+            owner->IORegistersArray[reg] = value & mask;
         }
 
         // check if file is valid
@@ -260,7 +411,7 @@ void update_timer(IORegisters* io_registers) {
 // DISK FUNCTIONS
 
 
-// Initialize disk
+// Initialize disk. diskout is made by disk_finish, a run that never writes a sector only copies diskin then
 void disk_init(const char* input_filename, const char* output_filename, Disk* disk) {
     disk->timer = 0;  // Set disk timer to initial state
 
@@ -270,111 +421,130 @@ void disk_init(const char* input_filename, const char* output_filename, Disk* di
     strncpy(disk->output_filename, output_filename, 255);
     disk->output_filename[255] = '\0';
 
-    // Initialize input and output file streams
-    FILE* input_file = fopen(input_filename, "r");
-    FILE* output_file = fopen(output_filename, "w");
+    disk->written = NULL;
+    memset(disk->dirty, 0, sizeof(disk->dirty));
+    disk->io = NULL;
+}
+
+// Strips the line break of a diskin line, returns 1 if the line is a word: 8 hex digits
+static int disk_line_word(char* line) {
+    line[strcspn(line, "\r\n")] = '\0';
+    return strlen(line) == 8 && strspn(line, "0123456789ABCDEFabcdef") == 8;
+}
+
+// Write the output disk file once: every valid line of diskin, a written sector replaces its lines.
+// Sectors written past the end of diskin are padded with zero lines
+void disk_finish(Disk* disk) {
+    FILE* input_file = fopen(disk->input_filename, "r");
+    FILE* output_file = fopen(disk->output_filename, "w");
 
     char line[16];  // string for 8 hexa
     int word_count = 0;
+    int written_end = 0;  // Word after the last written sector
 
-    // print to output file
-    while (fgets(line, sizeof(line), input_file)) {
+    for (int sector = 0; sector < NUM_OF_SECTORS; sector++) {
+        if (disk->dirty[sector / 32] & (1U << (sector % 32))) {
+            written_end = (sector + 1) * LINES_PER_SECTOR;
+        }
+    }
 
-        line[strcspn(line, "\r\n")] = '\0';
-        // Check if line is valid
-        if (strlen(line) != 8 || strspn(line, "0123456789ABCDEFabcdef") != 8) {
+    // print to output file
+    while (output_file && word_count < TOTAL_WORDS) {
+        int has_line = input_file && fgets(line, sizeof(line), input_file);
+        if (!has_line && word_count >= written_end) {
+            break;
+        }
+        if (has_line && !disk_line_word(line)) {
             continue;
         }
 
-        fprintf(output_file, "%.8s\n", line);
-        word_count++;
-
-        // Halt if disk is full
-        if (word_count >= TOTAL_WORDS) {
-            break;
+        int sector = word_count / LINES_PER_SECTOR;
+        if (disk->dirty[sector / 32] & (1U << (sector % 32))) {
+            fprintf(output_file, "%08X\n", disk->written[word_count]);
+        }
+        else {
+            fprintf(output_file, "%.8s\n", has_line ? line : "00000000");
         }
+        word_count++;
     }
 
-    fclose(input_file);
-    fclose(output_file);
-
+    if (input_file) {
+        fclose(input_file);
+    }
+    if (output_file) {
+        fclose(output_file);
+    }
+    free(disk->written);
+    disk->written = NULL;
 }
 
-// Read data sector
-void read_data_sector(Memory* memory, const IORegisters* io_registers, const Disk* disk) {
+// Read the words of a sector from a disk file. The sector starts at valid line sector * LINES_PER_SECTOR,
+// like in disk_finish, so it does not depend on the line endings of the file
+int read_sector_words(const char* filename, int32_t sector, int32_t words[LINES_PER_SECTOR]) {
 
     // Read data from disk sector
-    FILE* disk_file = fopen(disk->input_filename, "r");
+    FILE* disk_file = fopen(filename, "r");
     // check if file is valid
-    if (!disk_file) { return; }
+    if (!disk_file || sector < 0 || sector >= NUM_OF_SECTORS) {
+        if (disk_file) {
+            fclose(disk_file);
+        }
+        return 0;
+    }
 
     char current_line[16];  // string for 8 hexa
+    int first = sector * LINES_PER_SECTOR;
+    int word_count = 0;
     int i = 0;
 
-    // get sector and buffer
-    int32_t sector = io_registers->IORegistersArray[DISKSECTOR];
-    int32_t buffer = io_registers->IORegistersArray[DISKBUFFER];
-
-    // find the sector
-    if (fseek(disk_file, sector * LINES_PER_SECTOR * 10, SEEK_SET) != 0) {
-        fclose(disk_file);
-        return;
-    }
-
     while (i < LINES_PER_SECTOR && fgets(current_line, sizeof(current_line), disk_file)) {
-        // Strip starting newline character
-        current_line[strcspn(current_line, "\r\n")] = '\0';
-
-        // Check if line is valid
-        if (strlen(current_line) != 8 || strspn(current_line, "0123456789ABCDEFabcdef") != 8) {
+        // Skip the lines that are not words and the words before the sector
+        if (!disk_line_word(current_line) || word_count++ < first) {
             continue;
         }
-
-        int32_t word = (int32_t)strtoll(current_line, NULL, 16);
-        // Place the value in memory at the designated index
-        write_data_to_memory(memory, buffer + i, word);
+        words[i] = (int32_t)strtoll(current_line, NULL, 16);
         i += 1;
     }
 
     fclose(disk_file);
+    return i;
 }
 
-// write data sector
-void write_data_sector(const Memory* memory, const IORegisters* io_registers, const Disk* disk) {
+// Read data sector
+void read_data_sector(Memory* memory, const IORegisters* io_registers, const Disk* disk) {
+    int32_t words[LINES_PER_SECTOR];
+
+    // get sector and buffer
     int32_t sector = io_registers->IORegistersArray[DISKSECTOR];
     int32_t buffer = io_registers->IORegistersArray[DISKBUFFER];
 
-    // Write data to disk sector
-    FILE* disk_file = fopen(disk->output_filename, "r+");
-    if (!disk_file) {
-        return;
+    int word_num = read_sector_words(disk->input_filename, sector, words);
+    for (int i = 0; i < word_num; i++) {
+        // Place the value in memory at the designated index
+        write_data_to_memory(memory, buffer + i, words[i]);
     }
+}
 
-    // find the sector
-    if (fseek(disk_file, sector * LINES_PER_SECTOR * 10, SEEK_SET) != 0) {
-        fclose(disk_file);
+// write data sector into the written sectors, diskout is written by disk_finish
+void write_data_sector(const Memory* memory, const IORegisters* io_registers, Disk* disk) {
+    int32_t sector = io_registers->IORegistersArray[DISKSECTOR];
+    int32_t buffer = io_registers->IORegistersArray[DISKBUFFER];
+
+    if (sector < 0 || sector >= NUM_OF_SECTORS || disk->output_filename[0] == '\0') {
         return;
     }
-
-    // Initialize the sector with zeros to prevent leftover data
-    for (int i = 0; i < LINES_PER_SECTOR; i++) {
-        fprintf(disk_file, "00000000\n");
+    if (!disk->written) {
+        disk->written = malloc(TOTAL_WORDS * sizeof(int32_t));
+        if (!disk->written) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
     }
 
-    // Return file pointer to the beginning of the sector
-    fseek(disk_file, sector * LINES_PER_SECTOR * 10, SEEK_SET);
-
     for (int i = 0; i < LINES_PER_SECTOR; i++) {
-        int32_t word = read_data_from_memory(memory, buffer + i);
-
-        // print output
-        if (fprintf(disk_file, "%08X\n", word) < 0) {
-            fclose(disk_file);
-            return;
-        }
+        disk->written[sector * LINES_PER_SECTOR + i] = read_data_from_memory(memory, buffer + i);
     }
-
-    fclose(disk_file);
+    disk->dirty[sector / 32] |= 1U << (sector % 32);
 }
 
 // Process disk operation commands
@@ -384,6 +554,10 @@ void Process_disk_command(Memory* memory, IORegisters* io_registers, Disk* disk)
             disk->timer -= 1;
 
             if (disk->timer == 0) {
+                // The words of a read are in memory when the disk is done
+                if (memory->pending) {
+                    disk_io_complete(memory);
+                }
                 // Reset diskcmd
                 io_registers->IORegistersArray[DISKCMD] = 0;
                 // Mark disk as ready
@@ -398,8 +572,13 @@ void Process_disk_command(Memory* memory, IORegisters* io_registers, Disk* disk)
     if (io_registers->IORegistersArray[DISKCMD] != 0) {
         switch (io_registers->IORegistersArray[DISKCMD]) {
         case 1:
-            // Read sector operation
-            read_data_sector(memory, io_registers, disk);
+            // Read sector operation, on the I/O thread if the disk has one
+            if (disk->io) {
+                disk_io_read(disk->io, memory, io_registers->IORegistersArray[DISKSECTOR], io_registers->IORegistersArray[DISKBUFFER]);
+            }
+            else {
+                read_data_sector(memory, io_registers, disk);
+            }
             break;
 
         case 2:
@@ -459,7 +638,7 @@ void check_irq2(IORegisters* io_registers, IRQ2Data* irq2, int cycle) {
 }
 
 // Handle interrupts (1,2,3)
-void handle_all_interrupts(IORegisters* io_registers, int16_t* pc, int* in_interrupt) {
+void handle_all_interrupts(IORegisters* io_registers, int32_t* pc, int* in_interrupt) {
     int irq0 = io_registers->IORegistersArray[IRQ0ENABLE] & io_registers->IORegistersArray[IRQ0STATUS];
     int irq1 = io_registers->IORegistersArray[IRQ1ENABLE] & io_registers->IORegistersArray[IRQ1STATUS];
     int irq2 = io_registers->IORegistersArray[IRQ2ENABLE] & io_registers->IORegistersArray[IRQ2STATUS];
@@ -472,7 +651,7 @@ void handle_all_interrupts(IORegisters* io_registers, int16_t* pc, int* in_inter
     // if irq != 0 and 
     if (irq != 0 && *in_interrupt == 0) {
         io_registers->IORegistersArray[IRQRETURN] = *pc;
-        *pc = io_registers->IORegistersArray[IRQHANDLER] & 0x0FFF;
+        *pc = io_registers->IORegistersArray[IRQHANDLER] & ((1 << io_registers->address_bits) - 1);
         *in_interrupt = 1;
     }
 }
@@ -6,11 +6,32 @@
 
 
 // MEMORY DEFINITIONS
-#define DATA_MEM_DEPTH 4096
+#define DATA_MEM_DEPTH 4096         // Words of the default address space
+#define DEFAULT_ADDRESS_BITS 12
+#define MAX_ADDRESS_BITS 24         // -addrbits goes up to 16M words
+#define PAGE_BITS 10                // 1024 words, a 4 KB page
+#define PAGE_WORDS (1 << PAGE_BITS)
+#define TABLE_BITS 7                // Pages of a second level page table
+#define TABLE_SIZE (1 << TABLE_BITS)
+#define MEMORY_TLB_SIZE 16          // Recent pages of lw and sw, a power of 2
+
+// A recently used page
+typedef struct {
+    int page;           // Page number, -1 for an empty entry
+    int32_t* words;
+} MemoryTlbEntry;
 
-// Struct for memory
+// Struct for memory. The words are in pages that are allocated on the first write,
+// a page that was never written reads as zeros
 typedef struct {
-    int32_t data[DATA_MEM_DEPTH];    // Array for memory
+    int address_bits;                   // Width of the addresses and of the pc
+    int depth;                          // Words of the address space
+    int32_t*** directory;               // A page table for every TABLE_SIZE pages, NULL until one of its pages is written
+    int directory_size;
+    int page_num;                       // Allocated pages
+    int shared;                         // 1 when cores share the memory: all the pages are allocated and the TLB is not used
+    MemoryTlbEntry tlb[MEMORY_TLB_SIZE];
+    struct DiskIO* pending;             // Disk read whose words are not in memory yet, NULL otherwise
 } Memory;
 
 
@@ -70,19 +91,21 @@ typedef struct {
 #define DISKSECTOR      15 // Disk sector
 #define DISKBUFFER      16 // Disk buffer
 #define DISKSTATUS      17 // Disk status
-#define RESERVED1       18 // Reserved for future use
+#define COREID          18 // Number of the core, read only
 #define RESERVED2       19 // Reserved for future use
 #define MONITORADDR     20 // Monitor address
 #define MONITORDATA     21 // Monitor data
 #define MONITORCMD      22 // Monitor command
 
 // Struct for io registers
-typedef struct {
+typedef struct IORegisters {
     int32_t IORegistersArray[NUM_IO_REGISTERS]; // Array of io registers
     int halt;                                   // Halt flag for stopping the simulator
+    int address_bits;                           // Width of irqhandler, irqreturn and diskbuffer
+    struct IORegisters* devices;                // Registers of the disk and the monitor when another core owns them, NULL otherwise
 } IORegisters;
 
-// Define bit widths for each register
+// Define bit widths for each register, the 12 bit addresses follow address_bits
 static const int IO_REGISTER_SIZES[NUM_IO_REGISTERS] = {
     1,  1,  1,  1,  1,  1,  12, 12, 32, 32, 32, 1, 32, 32, 2, 7, 12, 1, 32, 32, 16, 8, 1
 };
@@ -98,11 +121,14 @@ static const int IO_REGISTER_SIZES[NUM_IO_REGISTERS] = {
 #define LINES_PER_SECTOR (SECTOR_SIZE / WORD_SIZE)  // 128 lines per sector
 #define TOTAL_WORDS (NUM_OF_SECTORS * (SECTOR_SIZE / WORD_SIZE))  // Total words on disk
 
-// Struct for Disk
+// Struct for Disk. diskout is written once at the end of the run, from diskin and the sectors that were written
 typedef struct {
     int timer;
     char input_filename[256];
-    char output_filename[256];
+    char output_filename[256];                  // Empty when the disk writes are not kept
+    int32_t* written;                           // Words of the written sectors, NULL until the first write
+    uint32_t dirty[NUM_OF_SECTORS / 32];        // A bit for every sector that was written
+    struct DiskIO* io;                          // Thread of the sector reads, NULL when they are synchronous
 } Disk;
 
 
@@ -126,14 +152,28 @@ typedef struct {
     uint8_t screen[MONITOR_HEIGHT][MONITOR_WIDTH]; // 256x256 pixels
 } Monitor;
 
-// Initialize all memory lines to 0
+// Initialize all memory lines to 0, with the default 12 bit addresses
 void memory_init(Memory* memory);
+// Initialize a memory of 1 << address_bits words, all 0
+void memory_init_width(Memory* memory, int address_bits);
+// Frees the pages of a memory
+void memory_free(Memory* memory);
+// Copies the words of a memory to another one of the same width, pages that are no longer used are freed
+void memory_copy(Memory* to, const Memory* from);
+// Allocates every page so that cores can share the memory
+void memory_share(Memory* memory);
+// Finds a page, NULL if it was never written
+int32_t* memory_page(const Memory* memory, int page);
+// lw: reads a word through the TLB
+int32_t memory_load(Memory* memory, int address);
 // loads instruction from memory file
 void load_instruction(const char* filename, Memory* memory);
-// Read an instruction from memory
-const int8_t* read_instruction_from_memory(const Memory* memory, int address);
+// Load memory words that are already in memory, e.g. from the assembler
+void load_words(Memory* memory, const int* words, int word_num);
+// Read an instruction from memory into the 4 bytes of instruction, NULL if the address is out of bounds
+const int8_t* read_instruction_from_memory(const Memory* memory, int address, int8_t instruction[4]);
 // Write to Memory out file
-void write_memory_out(const char* filename, const Memory* memory);
+void write_memory_out(const char* filename, const Memory* memory, int format);
 // Write a word to memory
 void write_data_to_memory(Memory* memory, int address, int32_t value);
 // Read a word from memory
@@ -147,6 +187,8 @@ void set_register(Registers* registers, int reg_index, int32_t value);
 
 // gets an io register index and return the name of the register
 char* io_names_for_output(int reg);
+// 1 for the registers of the disk and the monitor
+int is_device_register(int reg);
 // Initialize all io registers to 0 and Halt to 1
 void io_init(IORegisters* io_registers);
 // Reads a value from an io register and Prints the command to file
@@ -162,12 +204,16 @@ void write_total_cycles(const char* filename, const IORegisters* io_registers);
 // Updates the register that holdes the timer
 void update_timer(IORegisters* io_registers);
 
-// Initializes the disk structure and copies the input disk file to the output disk file.
+// Initializes the disk structure. No file is read or written until the end of the run
 void disk_init(const char* input_filename, const char* output_filename, Disk* disk);
+// Writes the output disk file: the valid lines of the input disk file with the sectors that were written
+void disk_finish(Disk* disk);
+// Reads the words of a sector from a disk file. Returns the number of words read
+int read_sector_words(const char* filename, int32_t sector, int32_t words[LINES_PER_SECTOR]);
 // read sector from disk
 void read_data_sector(Memory* memory, const IORegisters* io_registers, const Disk* disk);
 // write sector from disk
-void write_data_sector(const Memory* memory, const IORegisters* io_registers, const Disk* disk);
+void write_data_sector(const Memory* memory, const IORegisters* io_registers, Disk* disk);
 // Process disk command and update IRQ
 void Process_disk_command(Memory* memory, IORegisters* io_registers, Disk* disk);
 
@@ -176,7 +222,7 @@ void load_irq2(const char* filename, IRQ2Data* irq2);
 // Check if we have IRQ2 in the current cycle
 void check_irq2(IORegisters* io_registers, IRQ2Data* irq2, int cycle);
 //Handle IRQ0, IRQ1 and IRQ2
-void handle_all_interrupts(IORegisters* io_registers, int16_t* pc, int* in_interrupt);
+void handle_all_interrupts(IORegisters* io_registers, int32_t* pc, int* in_interrupt);
 
 // inits monitor
 void init_monitor(Monitor* monitor);
@@ -0,0 +1,134 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "diskio.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// DISK I/O THREAD FUNCTIONS
+
+// I/O thread: reads the queued sectors from diskin until the disk stops
+static int disk_io_thread(void* argument) {
+    DiskIO* io = argument;
+    int32_t words[LINES_PER_SECTOR];
+
+    mtx_lock(&io->lock);
+    for (;;) {
+        while (!io->queued && !io->quit) {
+            cnd_wait(&io->changed, &io->lock);
+        }
+        if (io->quit) {
+            break;
+        }
+        io->queued = 0;
+        int sector = io->transfer.sector;
+
+        // The file is read without the lock, the simulation only waits when it needs the words
+        mtx_unlock(&io->lock);
+        int word_num = read_sector_words(io->filename, sector, words);
+        mtx_lock(&io->lock);
+
+        for (int i = 0; i < word_num; i++) {
+            io->transfer.words[i] = words[i];
+        }
+        io->transfer.word_num = word_num;
+        io->transfer.done = 1;
+        cnd_broadcast(&io->changed);
+    }
+    mtx_unlock(&io->lock);
+    return 0;
+}
+
+// Starts the I/O thread of a disk
+int disk_io_start(Disk* disk) {
+    DiskIO* io = calloc(1, sizeof(DiskIO));
+    if (!io) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    io->filename = disk->input_filename;
+    if (mtx_init(&io->lock, mtx_plain) != thrd_success) {
+        free(io);
+        return -1;
+    }
+    if (cnd_init(&io->changed) != thrd_success) {
+        mtx_destroy(&io->lock);
+        free(io);
+        return -1;
+    }
+    if (thrd_create(&io->thread, disk_io_thread, io) != thrd_success) {
+        cnd_destroy(&io->changed);
+        mtx_destroy(&io->lock);
+        free(io);
+        return -1;
+    }
+    disk->io = io;
+    return 0;
+}
+
+// Queues the read of a sector into the buffer
+void disk_io_read(DiskIO* io, Memory* memory, int sector, int buffer) {
+    mtx_lock(&io->lock);
+    io->transfer.sector = sector;
+    io->transfer.buffer = buffer;
+    io->transfer.word_num = 0;
+    io->transfer.done = 0;
+    io->queued = 1;
+    cnd_broadcast(&io->changed);
+    mtx_unlock(&io->lock);
+    memory->pending = io;
+}
+
+// 1 if an address is in the buffer of a pending read
+int disk_io_in_buffer(const DiskIO* io, int address) {
+    return address >= io->transfer.buffer && address - io->transfer.buffer < LINES_PER_SECTOR;
+}
+
+// Waits until the I/O thread has read the sector
+static void wait_transfer(DiskIO* io) {
+    mtx_lock(&io->lock);
+    while (!io->transfer.done) {
+        cnd_wait(&io->changed, &io->lock);
+    }
+    mtx_unlock(&io->lock);
+}
+
+// Reads a word of the buffer of a pending read
+int disk_io_word(DiskIO* io, int address, int32_t* word) {
+    int i = address - io->transfer.buffer;
+    wait_transfer(io);
+    if (i >= io->transfer.word_num) {
+        return 0;
+    }
+    *word = io->transfer.words[i];
+    return 1;
+}
+
+// Waits for the pending read of memory and writes its words to memory, like read_data_sector
+void disk_io_complete(Memory* memory) {
+    DiskIO* io = memory->pending;
+    if (!io) {
+        return;
+    }
+    wait_transfer(io);
+    memory->pending = NULL;
+    for (int i = 0; i < io->transfer.word_num; i++) {
+        write_data_to_memory(memory, io->transfer.buffer + i, io->transfer.words[i]);
+    }
+}
+
+// Completes the pending read and stops the I/O thread of a disk
+void disk_io_stop(Disk* disk, Memory* memory) {
+    DiskIO* io = disk->io;
+    if (!io) {
+        return;
+    }
+    disk_io_complete(memory);
+    mtx_lock(&io->lock);
+    io->quit = 1;
+    cnd_broadcast(&io->changed);
+    mtx_unlock(&io->lock);
+    thrd_join(io->thread, NULL);
+    cnd_destroy(&io->changed);
+    mtx_destroy(&io->lock);
+    free(io);
+    disk->io = NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef DISKIO_H
+#define DISKIO_H
+
+#include <stdint.h>
+#include <threads.h>
+#include "data.h"
+
+// DISK I/O THREAD DEFINITIONS
+
+// A sector read from diskin that the I/O thread does while the simulated disk is busy.
+// Its words go to memory when the disk finishes or when the program writes into the buffer first
+typedef struct {
+    int sector;
+    int buffer;                         // First word of the buffer in memory
+    int32_t words[LINES_PER_SECTOR];
+    int word_num;                       // Words read from diskin, the rest of the buffer keeps its words
+    int done;                           // 1 when the I/O thread has read the sector
+} DiskTransfer;
+
+// The I/O thread of a disk. The fields are guarded by lock
+typedef struct DiskIO {
+    thrd_t thread;
+    mtx_t lock;
+    cnd_t changed;
+    const char* filename;               // diskin
+    DiskTransfer transfer;
+    int queued;                         // 1 when a read waits for the thread
+    int quit;
+} DiskIO;
+
+// Starts the I/O thread of a disk, its sector reads no longer stop the simulation. Returns 0 on success,
+// the disk stays synchronous otherwise
+int disk_io_start(Disk* disk);
+// Queues the read of a sector into the buffer. The read is pending in memory until disk_io_complete
+void disk_io_read(DiskIO* io, Memory* memory, int sector, int buffer);
+// 1 if an address is in the buffer of a pending read
+int disk_io_in_buffer(const DiskIO* io, int address);
+// Reads a word of the buffer of a pending read, waits for the I/O thread. Returns 1 if the read has the word,
+// 0 if the sector was too short and the word in memory stays
+int disk_io_word(DiskIO* io, int address, int32_t* word);
+// Waits for the pending read of memory and writes its words to memory
+void disk_io_complete(Memory* memory);
+// Completes the pending read and stops the I/O thread of a disk
+void disk_io_stop(Disk* disk, Memory* memory);
+#endif
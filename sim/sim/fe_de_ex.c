@@ -8,31 +8,23 @@
 
 
 // Fetch instruction
-const int8_t* instruction_fetch(const Memory* memory, int16_t* pc) {
+const int8_t* instruction_fetch(const Memory* memory, int32_t* pc, int8_t instruction_line[4]) {
     // Check if PC is valid
-    if (*pc > PC_MAX) { return NULL; }
+    if (*pc >= memory->depth) { return NULL; }
 
     // Fetch the instruction at the current PC
-    const int8_t* instruction = read_instruction_from_memory(memory, *pc);
+    const int8_t* instruction = read_instruction_from_memory(memory, *pc, instruction_line);
 
     if (instruction == NULL) { return NULL; } // Check if instruction is valid
     return instruction;
 }
 
-// Increase PC by 1
-void increase_pc(int16_t* pc) {
-    if (*pc < PC_MAX)
-    {
-        (*pc)++;
-    }
-}
-
 
 // DECODE FUNCTIONS
 
 
 // Decode instruction
-void instruction_decode(const int8_t* instruction_line, Instruction* decoded_instruction, int16_t pc, const Memory* memory, Registers* registers) {
+void instruction_decode(const int8_t* instruction_line, Instruction* decoded_instruction, int32_t pc, const Memory* memory, Registers* registers) {
     // Decode the opcode (bits 31:24) - byte 0
     decoded_instruction->opcode = instruction_line[0];
 
@@ -60,8 +52,9 @@ void instruction_decode(const int8_t* instruction_line, Instruction* decoded_ins
     // Handle immediate value based on bigimm flag
     if (decoded_instruction->is_bigimm) {
         // For bigimm instructions, read the next word from memory
-        if (pc + 1 < DATA_MEM_DEPTH) {
-            const uint8_t* next_word = read_instruction_from_memory(memory, pc + 1);
+        if (pc + 1 < memory->depth) {
+            int8_t next_line[4];
+            const uint8_t* next_word = (const uint8_t*)read_instruction_from_memory(memory, pc + 1, next_line);
             if (next_word) {
                 // Reconstruct 32-bit immediate from 4 bytes (big endian)
                 decoded_instruction->immediate = (int32_t)(
@@ -101,17 +94,17 @@ void instruction_decode(const int8_t* instruction_line, Instruction* decoded_ins
 
 // EXECUTE FUNCTIONS
 
-void instruction_execute(const Instruction* decoded_instruction, Registers* registers, int16_t* pc, Memory* memory, int* in_interrupt, FILE* hwregtrace_file, IORegisters* io_registers) {
+void instruction_execute(const Instruction* decoded_instruction, Registers* registers, int32_t* pc, Memory* memory, int* in_interrupt, FILE* hwregtrace_file, IORegisters* io_registers) {
 
     // Store current PC for trace and potential restoration
-    uint16_t current_pc = *pc;
+    int32_t current_pc = *pc;
 
     // Get register values
     int32_t rs_value = (decoded_instruction->rs == REG_IMM) ? decoded_instruction->immediate : get_register(registers, decoded_instruction->rs);
     int32_t rt_value = (decoded_instruction->rt == REG_IMM) ? decoded_instruction->immediate : get_register(registers, decoded_instruction->rt);
     int32_t rd_value = (decoded_instruction->rd == REG_IMM) ? decoded_instruction->immediate : get_register(registers, decoded_instruction->rd);
 
-    int16_t next_pc = *pc;
+    int32_t next_pc = *pc;
     if (decoded_instruction->is_bigimm) { next_pc += 2; } // bigimm instructions take 2 words
     else { next_pc += 1; } // normal instructions take 1 word
 
@@ -214,8 +207,8 @@ void instruction_execute(const Instruction* decoded_instruction, Registers* regi
 
     case OP_LW: {
         int32_t address = rs_value + rt_value;
-        if (decoded_instruction->rd != REG_ZERO && decoded_instruction->rd != REG_IMM && address >= 0 && address < DATA_MEM_DEPTH) {
-            set_register(registers, decoded_instruction->rd, read_data_from_memory(memory, address));
+        if (decoded_instruction->rd != REG_ZERO && decoded_instruction->rd != REG_IMM && address >= 0 && address < memory->depth) {
+            set_register(registers, decoded_instruction->rd, memory_load(memory, address));
         }
         *pc = next_pc;
         break;
@@ -223,7 +216,7 @@ void instruction_execute(const Instruction* decoded_instruction, Registers* regi
 
     case OP_SW: {
         int32_t address = rs_value + rt_value;
-        if (address >= 0 && address < DATA_MEM_DEPTH) {
+        if (address >= 0 && address < memory->depth) {
             write_data_to_memory(memory, address, rd_value);
         }
         *pc = next_pc;
@@ -231,7 +224,7 @@ void instruction_execute(const Instruction* decoded_instruction, Registers* regi
     }
 
     case OP_RETI:
-        *pc = io_registers->IORegistersArray[IRQRETURN] & 0x0FFF;
+        *pc = io_registers->IORegistersArray[IRQRETURN] & (memory->depth - 1);
         *in_interrupt = 0;
         break;
 
@@ -4,9 +4,6 @@
 #include <stdint.h>
 #include "data.h"
 
-// Maximum value for the PC
-#define PC_MAX 4095
-
 // Opcode definitions - according to SIMP ISA
 #define OP_ADD   0   // R[rd] = R[rs] + R[rt]
 #define OP_SUB   1   // R[rd] = R[rs] - R[rt]  
@@ -30,6 +27,25 @@
 #define OP_IN    19  // R[rd] = IORegister[R[rs] + R[rt]]
 #define OP_OUT   20  // IORegister[R[rs] + R[rt]] = R[rd]
 #define OP_HALT  21  // Halt execution, exit simulator
+#define NUM_OPCODES (OP_HALT + 1)
+
+// Assembly name of an opcode, NULL for an unknown opcode. The tables are in functions so that
+// the tools that only include this header get them without the simulator sources
+static inline const char* opcode_name(int opcode) {
+    static const char* const names[NUM_OPCODES] = {
+        "add", "sub", "mul", "and", "or", "xor", "sll", "sra", "srl", "beq", "bne", "blt", "bgt", "ble", "bge",
+        "jal", "lw", "sw", "reti", "in", "out", "halt"
+    };
+    return opcode >= 0 && opcode < NUM_OPCODES ? names[opcode] : NULL;
+}
+
+// Assembly name of a register, like $v0
+static inline const char* register_name(int reg) {
+    static const char* const names[NUM_REGISTERS] = {
+        "$zero", "$imm", "$v0", "$a0", "$a1", "$a2", "$a3", "$t0", "$t1", "$t2", "$s0", "$s1", "$s2", "$gp", "$sp", "$ra"
+    };
+    return names[reg & (NUM_REGISTERS - 1)];
+}
 
 // Structure to represent a decoded instruction
 typedef struct {
@@ -44,17 +60,14 @@ typedef struct {
 } Instruction;
 
 
-// PC+= 1
-void increase_pc(int16_t* pc);
-
 // Fetch functions
-const int8_t* instruction_fetch(const Memory* memory, int16_t* pc);
+const int8_t* instruction_fetch(const Memory* memory, int32_t* pc, int8_t instruction_line[4]);
 
 // Decode functions
-void instruction_decode(const int8_t* instruction_line, Instruction* decoded_instruction, int16_t pc, const Memory* memory, Registers* registers);
+void instruction_decode(const int8_t* instruction_line, Instruction* decoded_instruction, int32_t pc, const Memory* memory, Registers* registers);
 
 // Execute functions
-void instruction_execute(const Instruction* decoded_instruction, Registers* registers, int16_t* pc, Memory* memory, int* in_interrupt, FILE* hwregtrace_file, IORegisters* io);
+void instruction_execute(const Instruction* decoded_instruction, Registers* registers, int32_t* pc, Memory* memory, int* in_interrupt, FILE* hwregtrace_file, IORegisters* io);
 
 
 #endif
\ No newline at end of file
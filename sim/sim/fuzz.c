@@ -0,0 +1,538 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "fuzz.h"
+#include "fe_de_ex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+// FUZZER FUNCTIONS
+
+#define FUZZ_PASS -1    // Result of a schedule where all assertions hold
+#define FUZZ_HANG -2    // Result of a schedule where the program did not halt
+
+// Comparisons of the assertions
+static const char* const assertion_ops[] = { "==", "!=", "<", ">", "<=", ">=" };
+
+// A check of the final state, "$reg op value" or "mem[address] op value"
+typedef struct {
+    int is_memory;
+    int index;              // Register number or memory address
+    int op;                 // Index in assertion_ops
+    int32_t value;
+    int line_number;
+    char text[144];         // The assertion as written, for the report
+} Assertion;
+
+// State of the machine between two instructions
+typedef struct {
+    Registers registers;
+    Memory memory;
+    IORegisters io_registers;
+    Monitor monitor;
+    Disk disk;
+    int32_t pc;
+    int in_interrupt;
+    uint64_t cycles;
+} MachineState;
+
+// IRQ2 events and timer phase of one run from the snapshot
+typedef struct {
+    int events[FUZZ_MAX_EVENTS];    // Sorted cycles
+    int event_num;
+    int has_timer;                  // 1 if timercurrent is set at the snapshot
+    int32_t timer_current;
+} Schedule;
+
+// Settings and results of a fuzz run, shared by the worker threads
+typedef struct {
+    const MachineState* start;      // The snapshot
+    Assertion assertions[FUZZ_MAX_ASSERTIONS];
+    int assertion_num;
+    int schedule_num;
+    int max_events;
+    int timer;
+    int32_t from;                   // Clock cycle of the snapshot
+    int32_t window;                 // The IRQ2 events are in [from, from + window)
+    uint64_t seed;
+    uint64_t max_cycles;            // Cycles a schedule may run after the snapshot
+    int* results;                   // Result of each schedule
+    int next_schedule;              // Guarded by lock
+    mtx_t lock;
+} Fuzz;
+
+// Reads the assertions file. Returns 0 on success
+static int read_assertions(Fuzz* fuzz, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    char line[256];
+    int line_number = 0;
+
+    if (!file) {
+        printf("Error: Could not open assertions file '%s'.\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char left[64], op[8], right[64];
+        line_number++;
+        int fields = sscanf(line, "%63s %7s %63s", left, op, right);
+        if (fields <= 0 || left[0] == '#') {
+            continue;
+        }
+        if (fuzz->assertion_num >= FUZZ_MAX_ASSERTIONS) {
+            printf("Error: More than %d assertions.\n", FUZZ_MAX_ASSERTIONS);
+            fclose(file);
+            return -1;
+        }
+
+        Assertion* assertion = &fuzz->assertions[fuzz->assertion_num];
+        char* end = NULL;
+        assertion->op = -1;
+        assertion->index = -1;
+        assertion->line_number = line_number;
+        for (int i = 0; fields == 3 && i < (int)(sizeof(assertion_ops) / sizeof(assertion_ops[0])); i++) {
+            if (strcmp(op, assertion_ops[i]) == 0) {
+                assertion->op = i;
+            }
+        }
+        if (strncmp(left, "mem[", 4) == 0) {
+            assertion->is_memory = 1;
+            long address = strtol(left + 4, &end, 0);
+            if (end != left + 4 && strcmp(end, "]") == 0 && address >= 0 && address < DATA_MEM_DEPTH) {
+                assertion->index = (int)address;
+            }
+        }
+        else {
+            assertion->is_memory = 0;
+            for (int r = 0; r < NUM_REGISTERS; r++) {
+                if (strcmp(left, register_name(r)) == 0) {
+                    assertion->index = r;
+                }
+            }
+        }
+        if (fields == 3) {
+            assertion->value = (int32_t)strtoll(right, &end, 0);
+        }
+        if (fields != 3 || assertion->op < 0 || assertion->index < 0 || *end != '\0') {
+            printf("Error: Line %d of the assertions file is not like '$v0 == 5' or 'mem[0x100] != 0'.\n", line_number);
+            fclose(file);
+            return -1;
+        }
+        snprintf(assertion->text, sizeof(assertion->text), "%s %s %s", left, op, right);
+        fuzz->assertion_num++;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Value that an assertion checks in the final state
+static int32_t assertion_actual(const Assertion* assertion, const MachineState* state) {
+    if (assertion->is_memory) {
+        return read_data_from_memory(&state->memory, assertion->index);
+    }
+    return state->registers.regs[assertion->index];
+}
+
+// Checks the assertions. Returns the index of the first one that fails, or FUZZ_PASS
+static int check_assertions(const Fuzz* fuzz, const MachineState* state) {
+    for (int i = 0; i < fuzz->assertion_num; i++) {
+        const Assertion* assertion = &fuzz->assertions[i];
+        int32_t actual = assertion_actual(assertion, state);
+        int holds = 0;
+        switch (assertion->op) {
+        case 0: holds = actual == assertion->value; break;
+        case 1: holds = actual != assertion->value; break;
+        case 2: holds = actual < assertion->value; break;
+        case 3: holds = actual > assertion->value; break;
+        case 4: holds = actual <= assertion->value; break;
+        case 5: holds = actual >= assertion->value; break;
+        }
+        if (!holds) {
+            return i;
+        }
+    }
+    return FUZZ_PASS;
+}
+
+// Runs the machine until it halts or reaches stop_cycle. With stop_at_irq2 it also stops when IRQ2 is enabled.
+// The fuzzer writes no trace, leds or display7seg files
+static void run_state(MachineState* state, IRQ2Data* irq2, uint64_t stop_cycle, int stop_at_irq2) {
+    Machine machine;
+    memset(&machine, 0, sizeof(Machine));
+    machine.registers = &state->registers;
+    machine.memory = &state->memory;
+    machine.io_registers = &state->io_registers;
+    machine.irq2 = irq2;
+    machine.monitor = &state->monitor;
+    machine.disk = &state->disk;
+    machine.pc = state->pc;
+    machine.in_interrupt = state->in_interrupt;
+    machine.cycles = state->cycles;
+
+    while (state->io_registers.halt && machine.cycles < stop_cycle) {
+        if (stop_at_irq2 && state->io_registers.IORegistersArray[IRQ2ENABLE]) {
+            break;
+        }
+        machine_step(&machine);
+    }
+    state->pc = machine.pc;
+    state->in_interrupt = machine.in_interrupt;
+    state->cycles = machine.cycles;
+}
+
+// Copies a state, the memory of to has to be initialized
+static void copy_state(MachineState* to, const MachineState* from) {
+    Memory memory = to->memory;
+    *to = *from;
+    to->memory = memory;
+    memory_copy(&to->memory, &from->memory);
+}
+
+// Runs a schedule from the snapshot. Returns FUZZ_PASS, FUZZ_HANG or the index of the assertion that fails
+static int run_schedule(const Fuzz* fuzz, const Schedule* schedule, MachineState* state) {
+    IRQ2Data irq2;
+
+    copy_state(state, fuzz->start);
+    if (schedule->has_timer) {
+        state->io_registers.IORegistersArray[TIMERCURRENT] = schedule->timer_current;
+    }
+    irq2.events_array = (int*)schedule->events;
+    irq2.num_of_events = schedule->event_num;
+    irq2.size = schedule->event_num;
+    irq2.index = 0;
+    run_state(state, &irq2, fuzz->start->cycles + fuzz->max_cycles, 0);
+    if (state->io_registers.halt) {
+        return FUZZ_HANG;
+    }
+    return check_assertions(fuzz, state);
+}
+
+// xorshift64* random numbers
+static uint64_t next_random(uint64_t* random) {
+    *random ^= *random >> 12;
+    *random ^= *random << 25;
+    *random ^= *random >> 27;
+    return *random * 2685821657736338717ull;
+}
+
+// Makes the random schedule of a number, the same for the same seed on any number of threads
+static void make_schedule(const Fuzz* fuzz, int number, Schedule* schedule) {
+    uint64_t random = (fuzz->seed + 1) * 0x9E3779B97F4A7C15ull ^ ((uint64_t)number + 1) * 0xD1B54A32D192ED03ull;
+    if (random == 0) {
+        random = 1;
+    }
+
+    int count = 1 + (int)(next_random(&random) % (uint64_t)fuzz->max_events);
+    schedule->event_num = 0;
+    for (int i = 0; i < count; i++) {
+        int cycle = fuzz->from + (int)(next_random(&random) % (uint64_t)fuzz->window);
+        // Insert sorted, IRQ2 events must be increasing
+        int j = schedule->event_num;
+        while (j > 0 && schedule->events[j - 1] > cycle) {
+            schedule->events[j] = schedule->events[j - 1];
+            j--;
+        }
+        if (j > 0 && schedule->events[j - 1] == cycle) {
+            memmove(&schedule->events[j], &schedule->events[j + 1], (size_t)(schedule->event_num - j) * sizeof(int));
+            continue;
+        }
+        schedule->events[j] = cycle;
+        schedule->event_num++;
+    }
+
+    int32_t timer_max = fuzz->start->io_registers.IORegistersArray[TIMERMAX];
+    schedule->has_timer = fuzz->timer && timer_max > 0;
+    schedule->timer_current = schedule->has_timer ? (int32_t)(next_random(&random) % (uint64_t)timer_max) : 0;
+}
+
+// Removes the IRQ2 events and the timer phase that the failure does not need.
+// The smaller schedule has to fail with the same result
+static void minimize_schedule(const Fuzz* fuzz, Schedule* schedule, int result, MachineState* state) {
+    for (int i = 0; i < schedule->event_num;) {
+        Schedule smaller = *schedule;
+        memmove(&smaller.events[i], &smaller.events[i + 1], (size_t)(smaller.event_num - i - 1) * sizeof(int));
+        smaller.event_num--;
+        if (run_schedule(fuzz, &smaller, state) == result) {
+            *schedule = smaller;
+        }
+        else {
+            i++;
+        }
+    }
+    if (schedule->has_timer) {
+        Schedule smaller = *schedule;
+        smaller.has_timer = 0;
+        if (run_schedule(fuzz, &smaller, state) == result) {
+            *schedule = smaller;
+        }
+    }
+}
+
+// Prints the events and the timer phase of a schedule
+static void print_schedule(const Schedule* schedule) {
+    printf("IRQ2 at");
+    if (schedule->event_num == 0) {
+        printf(" no cycle");
+    }
+    for (int i = 0; i < schedule->event_num; i++) {
+        printf(" %d", schedule->events[i]);
+    }
+    if (schedule->has_timer) {
+        printf(", timercurrent %d at the snapshot", schedule->timer_current);
+    }
+}
+
+// Worker thread: runs the next schedule until all schedules ran
+static int fuzz_worker(void* argument) {
+    Fuzz* fuzz = argument;
+    MachineState* state = malloc(sizeof(MachineState));
+    Schedule schedule;
+    if (!state) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    memory_init(&state->memory);
+
+    for (;;) {
+        mtx_lock(&fuzz->lock);
+        int number = fuzz->next_schedule++;
+        mtx_unlock(&fuzz->lock);
+        if (number >= fuzz->schedule_num) {
+            break;
+        }
+        make_schedule(fuzz, number, &schedule);
+        fuzz->results[number] = run_schedule(fuzz, &schedule, state);
+    }
+    memory_free(&state->memory);
+    free(state);
+    return 0;
+}
+
+// Loads the program into a state at cycle 0. Disk reads come from diskin, disk writes are not kept
+static void init_state(MachineState* state, const char* memin, const char* diskin) {
+    memset(state, 0, sizeof(MachineState));
+    registers_init(&state->registers);
+    memory_init(&state->memory);
+    load_instruction(memin, &state->memory);
+    io_init(&state->io_registers);
+    init_monitor(&state->monitor);
+    snprintf(state->disk.input_filename, sizeof(state->disk.input_filename), "%s", diskin);
+}
+
+// Minimizes the first failing schedules and writes each different one as an irq2in file:
+// the events of irq2in before the snapshot and the events of the schedule
+static void report_failures(Fuzz* fuzz, const IRQ2Data* irq2, int prefix_events, const char* prefix) {
+    Schedule reported[FUZZ_MAX_REPORTS];
+    int report_num = 0;
+    MachineState* state = malloc(sizeof(MachineState));
+    if (!state) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    memory_init(&state->memory);
+
+    for (int number = 0; number < fuzz->schedule_num && report_num < FUZZ_MAX_REPORTS; number++) {
+        int result = fuzz->results[number];
+        if (result == FUZZ_PASS) {
+            continue;
+        }
+        Schedule schedule;
+        make_schedule(fuzz, number, &schedule);
+        minimize_schedule(fuzz, &schedule, result, state);
+        int seen = 0;
+        for (int i = 0; i < report_num; i++) {
+            seen |= reported[i].event_num == schedule.event_num && reported[i].has_timer == schedule.has_timer &&
+                reported[i].timer_current == schedule.timer_current && memcmp(reported[i].events, schedule.events, (size_t)schedule.event_num * sizeof(int)) == 0;
+        }
+        if (seen) {
+            continue;
+        }
+        reported[report_num++] = schedule;
+
+        // Run the minimized schedule again for the final values
+        run_schedule(fuzz, &schedule, state);
+        if (result == FUZZ_HANG) {
+            printf("Schedule %d fails: the program did not halt within %llu cycles\n", number, (unsigned long long)fuzz->max_cycles);
+        }
+        else {
+            const Assertion* assertion = &fuzz->assertions[result];
+            printf("Schedule %d fails: %s on line %d, the value is %d\n", number, assertion->text, assertion->line_number, assertion_actual(assertion, state));
+        }
+
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s%d.txt", prefix, report_num);
+        FILE* file = fopen(filename, "w");
+        if (file) {
+            for (int i = 0; i < prefix_events; i++) {
+                fprintf(file, "%d\n", irq2->events_array[i]);
+            }
+            for (int i = 0; i < schedule.event_num; i++) {
+                fprintf(file, "%d\n", schedule.events[i]);
+            }
+            fclose(file);
+        }
+        printf("    Minimized: ");
+        print_schedule(&schedule);
+        printf(", written to %s%s\n", file ? filename : "(could not write) ", schedule.has_timer ? " without the timer phase" : "");
+    }
+    memory_free(&state->memory);
+    free(state);
+}
+
+// sim fuzz [options] <memin> <diskin> <irq2in> <assertions>
+int run_fuzz(int argc, char* argv[]) {
+    Fuzz* fuzz = calloc(1, sizeof(Fuzz));
+    const char* files[4];
+    const char* prefix = "irq2fail";
+    int file_num = 0;
+    int thread_num = 1;
+    int64_t from = -1;
+    int64_t window = 0;
+    int valid = 1;
+    if (!fuzz) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+
+    fuzz->schedule_num = FUZZ_DEFAULT_SCHEDULES;
+    fuzz->max_events = FUZZ_DEFAULT_EVENTS;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            fuzz->schedule_num = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-events") == 0 && i + 1 < argc) {
+            fuzz->max_events = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-from") == 0 && i + 1 < argc) {
+            from = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            window = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-timer") == 0) {
+            fuzz->timer = 1;
+        }
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            fuzz->seed = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-max-cycles") == 0 && i + 1 < argc) {
+            fuzz->max_cycles = strtoull(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_num = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            prefix = argv[++i];
+        }
+        else if (argv[i][0] != '-' && file_num < 4) {
+            files[file_num++] = argv[i];
+        }
+        else {
+            valid = 0;
+        }
+    }
+    if (!valid || file_num != 4 || fuzz->schedule_num < 1 || fuzz->max_events < 1 || fuzz->max_events > FUZZ_MAX_EVENTS ||
+        thread_num < 1 || window < 0 || window > INT32_MAX || from > INT32_MAX) {
+        printf("Usage: %s fuzz [-n schedules] [-events 1-%d] [-from cycle] [-window cycles] [-timer] [-seed S] [-max-cycles M] [-j threads] [-o prefix] <memin> <diskin> <irq2in> <assertions>\n",
+            argv[0], FUZZ_MAX_EVENTS);
+        free(fuzz);
+        return FUZZ_EXIT_ERROR;
+    }
+    if (read_assertions(fuzz, files[3]) != 0) {
+        free(fuzz);
+        return FUZZ_EXIT_ERROR;
+    }
+    for (int i = 1; i <= 2; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (!file) {
+            printf("Error: Could not open input file '%s'.\n", files[i]);
+            free(fuzz);
+            return FUZZ_EXIT_ERROR;
+        }
+        fclose(file);
+    }
+
+    // Run with irq2in to the snapshot, then on to the end for the length of the run
+    MachineState* start = malloc(sizeof(MachineState));
+    MachineState* base = malloc(sizeof(MachineState));
+    IRQ2Data irq2;
+    if (!start || !base) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    init_state(start, files[0], files[1]);
+    load_irq2(files[2], &irq2);
+    run_state(start, &irq2, from >= 0 ? (uint64_t)from : UINT64_MAX, from < 0);
+    int prefix_events = irq2.index;
+    memory_init(&base->memory);
+    copy_state(base, start);
+    run_state(base, &irq2, fuzz->max_cycles ? start->cycles + fuzz->max_cycles : UINT64_MAX, 0);
+
+    int result = FUZZ_HANG;
+    if (!base->io_registers.halt) {
+        result = check_assertions(fuzz, base);
+    }
+    if (result != FUZZ_PASS) {
+        if (result == FUZZ_HANG) {
+            printf("Error: The program does not halt with '%s' within %llu cycles.\n", files[2], (unsigned long long)fuzz->max_cycles);
+        }
+        else {
+            printf("Error: '%s' fails with '%s', the value is %d.\n", fuzz->assertions[result].text, files[2], assertion_actual(&fuzz->assertions[result], base));
+        }
+        free(irq2.events_array);
+        memory_free(&base->memory);
+        memory_free(&start->memory);
+        free(base);
+        free(start);
+        free(fuzz);
+        return FUZZ_EXIT_ERROR;
+    }
+
+    uint64_t length = base->cycles - start->cycles;
+    fuzz->start = start;
+    fuzz->from = start->io_registers.IORegistersArray[CLKS];
+    fuzz->window = window > 0 ? (int32_t)window : (length > 0 && length < INT32_MAX ? (int32_t)length : 1);
+    if (fuzz->max_cycles == 0) {
+        fuzz->max_cycles = 4 * length + 100000;
+    }
+    printf("Snapshot at cycle %d%s, IRQ2 events in cycles %d to %d\n", fuzz->from,
+        from < 0 ? (start->io_registers.halt ? " where IRQ2 is enabled" : " where the program halted") : "",
+        fuzz->from, fuzz->from + fuzz->window - 1);
+
+    // Run the schedules on the threads
+    fuzz->results = malloc((size_t)fuzz->schedule_num * sizeof(int));
+    thrd_t* threads = malloc((size_t)thread_num * sizeof(thrd_t));
+    if (!fuzz->results || !threads || mtx_init(&fuzz->lock, mtx_plain) != thrd_success) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    int started = 0;
+    for (; started < thread_num; started++) {
+        if (thrd_create(&threads[started], fuzz_worker, fuzz) != thrd_success) {
+            break;
+        }
+    }
+    // Work on the calling thread too if no thread could be started
+    if (started == 0) {
+        fuzz_worker(fuzz);
+    }
+    for (int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    mtx_destroy(&fuzz->lock);
+    free(threads);
+
+    int failed = 0;
+    for (int i = 0; i < fuzz->schedule_num; i++) {
+        failed += fuzz->results[i] != FUZZ_PASS;
+    }
+    report_failures(fuzz, &irq2, prefix_events, prefix);
+    printf("Ran %d IRQ2 schedules: %d failed\n", fuzz->schedule_num, failed);
+
+    free(fuzz->results);
+    free(irq2.events_array);
+    memory_free(&base->memory);
+    memory_free(&start->memory);
+    free(base);
+    free(start);
+    free(fuzz);
+    return failed > 0 ? FUZZ_EXIT_FAILED : FUZZ_EXIT_PASS;
+}
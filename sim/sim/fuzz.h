@@ -0,0 +1,25 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "machine.h"
+
+// FUZZER DEFINITIONS
+#define FUZZ_DEFAULT_SCHEDULES 1000
+#define FUZZ_DEFAULT_EVENTS 4       // Most IRQ2 events in a random schedule
+#define FUZZ_MAX_EVENTS 64
+#define FUZZ_MAX_ASSERTIONS 256
+#define FUZZ_MAX_REPORTS 10         // Failing schedules that are minimized and written to files
+#define FUZZ_EXIT_PASS 0            // Exit codes of sim fuzz
+#define FUZZ_EXIT_FAILED 1
+#define FUZZ_EXIT_ERROR 2
+
+// sim fuzz [-n schedules] [-events K] [-from cycle] [-window cycles] [-timer] [-seed S] [-max-cycles M] [-j threads] [-o prefix]
+//          <memin> <diskin> <irq2in> <assertions>
+// Explores IRQ2 arrival times. The program runs once with irq2in up to the snapshot cycle, by default the cycle
+// where it first enables IRQ2. Every schedule starts from a copy of the snapshot with up to K random IRQ2 events
+// in the window after it, and with -timer a random timer phase. The final registers and memory are checked
+// against the assertions file, lines like "$v0 == 5" or "mem[0x100] != 0". Failing schedules are minimized
+// and written as irq2in files that replay the failure with sim. Prints the number of failing schedules and returns
+// FUZZ_EXIT_PASS if none fails, FUZZ_EXIT_FAILED if any fails, FUZZ_EXIT_ERROR on errors
+int run_fuzz(int argc, char* argv[]);
+#endif
@@ -0,0 +1,509 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "lockstep.h"
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include "fe_de_ex.h"
+#include "../../asm/asm/simp_asm.h"
+
+// LOCKSTEP FUNCTIONS
+
+
+// One instance of the program
+typedef struct {
+    Machine machine;        // The registers are in the group, machine.registers is not used
+    Memory memory;
+    IORegisters io_registers;
+    IRQ2Data irq2;
+    Disk disk;
+    Monitor monitor;
+    char** files;           // The 13 files of the instance
+    int waiting;            // Steps since the lane last ran
+    int failed;             // 1 if the input files could not be opened
+} Lane;
+
+// Lanes that run in lockstep. The registers are stored struct-of-arrays, regs[register][lane]
+typedef struct {
+    int32_t regs[NUM_REGISTERS][LOCKSTEP_MAX_LANES];
+    Lane* lanes;
+    int lane_num;
+} LaneGroup;
+
+// Jobs of a sweep, shared by the worker threads
+typedef struct {
+    char** files;           // 13 files per job
+    int job_num;
+    int job_capacity;
+    int lane_num;
+    int next_job;           // Next job to take, guarded by lock
+    int failed;             // Jobs that failed, guarded by lock
+    mtx_t lock;
+} Sweep;
+
+// Copies a string to the heap
+static char* copy_string(const char* text) {
+    size_t length = strlen(text);
+    char* copy = malloc(length + 1);
+    if (!copy) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    memcpy(copy, text, length + 1);
+    return copy;
+}
+
+// Reads the jobs file, 13 files per line. Empty lines and lines that start with # are skipped
+static int read_sweep_jobs(Sweep* sweep, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    char line[4096];
+    int line_number = 0;
+
+    if (!file) {
+        printf("Error: Could not open jobs file '%s'.\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char* names[14];
+        int name_num = 0;
+        line_number++;
+        for (char* name = strtok(line, " \t\r\n"); name && name_num < 14; name = strtok(NULL, " \t\r\n")) {
+            names[name_num++] = name;
+        }
+        if (name_num == 0 || names[0][0] == '#') {
+            continue;
+        }
+        if (name_num != 13) {
+            printf("Error: Line %d of the jobs file does not have 13 files.\n", line_number);
+            fclose(file);
+            return -1;
+        }
+        if (sweep->job_num >= sweep->job_capacity) {
+            sweep->job_capacity = sweep->job_capacity ? sweep->job_capacity * 2 : 16;
+            sweep->files = realloc(sweep->files, (size_t)sweep->job_capacity * 13 * sizeof(char*));
+            if (!sweep->files) {
+                printf("Error: Out of memory\n");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < 13; i++) {
+            sweep->files[sweep->job_num * 13 + i] = copy_string(names[i]);
+        }
+        sweep->job_num++;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Loads an instance into a lane, like run_program does for a single run. Returns 0 on success
+static int setup_lane(LaneGroup* group, int index, char** files) {
+    Lane* lane = &group->lanes[index];
+    Machine* machine = &lane->machine;
+
+    memset(machine, 0, sizeof(Machine));
+    lane->files = files;
+    lane->waiting = 0;
+    lane->failed = 0;
+    io_init(&lane->io_registers);
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        group->regs[r][index] = 0;
+    }
+
+    // The simulator needs the disk and IRQ2 input files
+    for (int i = 1; i <= 2; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (!file) {
+            printf("Error: Could not open input file '%s'.\n", files[i]);
+            return -1;
+        }
+        fclose(file);
+    }
+
+    memory_init(&lane->memory);
+    load_instruction(files[0], &lane->memory);
+    disk_init(files[1], files[10], &lane->disk);
+    init_monitor(&lane->monitor);
+    load_irq2(files[2], &lane->irq2);
+
+    machine->memory = &lane->memory;
+    machine->io_registers = &lane->io_registers;
+    machine->irq2 = &lane->irq2;
+    machine->monitor = &lane->monitor;
+    machine->disk = &lane->disk;
+    if (machine_open_files(machine, files[5], files[6], files[8], files[9]) != 0) {
+        printf("Error: Could not open the output files of '%s'.\n", files[0]);
+        free(lane->irq2.events_array);
+        memory_free(&lane->memory);
+        return -1;
+    }
+    return 0;
+}
+
+// Copies the registers of a lane out of the group
+static void gather_registers(const LaneGroup* group, int index, Registers* registers) {
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        registers->regs[r] = group->regs[r][index];
+    }
+    registers->imm = 0;
+}
+
+// Runs an ALU opcode on all lanes. The loops have no branches so the compiler can use vector instructions.
+// Arithmetic wraps around and shift counts use 5 bits, like the interpreter on the host
+static void alu_lanes(int opcode, int32_t result[], const int32_t a[], const int32_t b[]) {
+    switch (opcode) {
+    case OP_ADD:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = (int32_t)((uint32_t)a[l] + (uint32_t)b[l]); }
+        break;
+    case OP_SUB:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = (int32_t)((uint32_t)a[l] - (uint32_t)b[l]); }
+        break;
+    case OP_MUL:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = (int32_t)((uint32_t)a[l] * (uint32_t)b[l]); }
+        break;
+    case OP_AND:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = a[l] & b[l]; }
+        break;
+    case OP_OR:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = a[l] | b[l]; }
+        break;
+    case OP_XOR:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = a[l] ^ b[l]; }
+        break;
+    case OP_SLL:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = (int32_t)((uint32_t)a[l] << (b[l] & 31)); }
+        break;
+    case OP_SRA:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = a[l] >> (b[l] & 31); }
+        break;
+    case OP_SRL:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { result[l] = (int32_t)((uint32_t)a[l] >> (b[l] & 31)); }
+        break;
+    }
+}
+
+// Compares the lanes for a branch opcode, -1 where the branch is taken
+static void compare_lanes(int opcode, int32_t taken[], const int32_t a[], const int32_t b[]) {
+    switch (opcode) {
+    case OP_BEQ:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] == b[l]); }
+        break;
+    case OP_BNE:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] != b[l]); }
+        break;
+    case OP_BLT:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] < b[l]); }
+        break;
+    case OP_BGT:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] > b[l]); }
+        break;
+    case OP_BLE:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] <= b[l]); }
+        break;
+    case OP_BGE:
+        for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) { taken[l] = -(a[l] >= b[l]); }
+        break;
+    }
+}
+
+// Runs the instructions that use the memory or the devices of a lane, like instruction_execute
+static void execute_lane(LaneGroup* group, int index, const Instruction* decoded, int32_t pc, int32_t next_pc) {
+    Lane* lane = &group->lanes[index];
+    Machine* machine = &lane->machine;
+    int32_t rs_value = group->regs[decoded->rs][index];
+    int32_t rt_value = group->regs[decoded->rt][index];
+    int32_t rd_value = group->regs[decoded->rd][index];
+    int32_t address = (int32_t)((uint32_t)rs_value + (uint32_t)rt_value);
+    int writes_rd = decoded->rd != REG_ZERO && decoded->rd != REG_IMM;
+
+    switch (decoded->opcode) {
+    case OP_JAL:
+        if (writes_rd) {
+            group->regs[decoded->rd][index] = next_pc;
+        }
+        machine->pc = rs_value;
+        break;
+
+    case OP_LW:
+        if (writes_rd && address >= 0 && address < lane->memory.depth) {
+            group->regs[decoded->rd][index] = memory_load(&lane->memory, address);
+        }
+        machine->pc = next_pc;
+        break;
+
+    case OP_SW:
+        if (address >= 0 && address < lane->memory.depth) {
+            write_data_to_memory(&lane->memory, address, rd_value);
+        }
+        machine->pc = next_pc;
+        break;
+
+    case OP_RETI:
+        machine->pc = lane->io_registers.IORegistersArray[IRQRETURN] & (lane->memory.depth - 1);
+        machine->in_interrupt = 0;
+        break;
+
+    case OP_IN:
+        if (writes_rd && address >= 0 && address < NUM_IO_REGISTERS) {
+            group->regs[decoded->rd][index] = read_from_io(&lane->io_registers, address, machine->hwregtrace_file);
+        }
+        machine->pc = next_pc;
+        break;
+
+    case OP_OUT:
+        if (address >= 0 && address < NUM_IO_REGISTERS) {
+            write_to_io(&lane->io_registers, address, rd_value, machine->hwregtrace_file);
+        }
+        machine->pc = next_pc;
+        break;
+
+    case OP_HALT:
+        machine->pc = pc;
+        lane->io_registers.halt = 0;
+        break;
+
+    default:
+        // The interpreter does not change the pc for an unknown opcode
+        machine->pc = pc;
+        break;
+    }
+}
+
+// Runs the next instruction on the lanes at the lowest pc. Returns 0 when all lanes halted
+static int step_group(LaneGroup* group) {
+    int32_t mask[LOCKSTEP_MAX_LANES];
+    int32_t result[LOCKSTEP_MAX_LANES];
+    Registers snapshots[LOCKSTEP_MAX_LANES];
+    int leader = -1;
+
+    // The lowest pc lets lanes that took different paths meet again where the paths join.
+    // A lane that waited too long runs anyway, e.g. while another lane spins in a loop
+    for (int l = 0; l < group->lane_num; l++) {
+        const Lane* lane = &group->lanes[l];
+        if (!lane->io_registers.halt) {
+            continue;
+        }
+        if (lane->waiting >= LOCKSTEP_STARVE_LIMIT) {
+            leader = l;
+            break;
+        }
+        if (leader < 0 || lane->machine.pc < group->lanes[leader].machine.pc) {
+            leader = l;
+        }
+    }
+    if (leader < 0) {
+        return 0;
+    }
+
+    // Decode the instruction of the leader once
+    Lane* first = &group->lanes[leader];
+    int32_t pc = first->machine.pc;
+    int8_t instruction_line[4];
+    if (!read_instruction_from_memory(&first->memory, pc, instruction_line)) {
+        printf("Error: The pc %d is outside of the memory in '%s'\n", pc, first->files[0]);
+        first->io_registers.halt = 0;
+        return 1;
+    }
+    int32_t instruction = read_data_from_memory(&first->memory, pc);
+    Instruction decoded;
+    Registers scratch;
+    registers_init(&scratch);
+    instruction_decode(instruction_line, &decoded, pc, &first->memory, &scratch);
+    int has_next_word = decoded.is_bigimm && pc + 1 < first->memory.depth;
+    int32_t next_word = has_next_word ? read_data_from_memory(&first->memory, pc + 1) : 0;
+    int32_t next_pc = pc + (decoded.is_bigimm ? 2 : 1);
+
+    // The lanes at the same pc with the same instruction run together
+    for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) {
+        Lane* lane = &group->lanes[l];
+        if (l >= group->lane_num || !lane->io_registers.halt) {
+            mask[l] = 0;
+            continue;
+        }
+        int same = lane->machine.pc == pc && read_data_from_memory(&lane->memory, pc) == instruction &&
+            (!has_next_word || read_data_from_memory(&lane->memory, pc + 1) == next_word);
+        mask[l] = same ? -1 : 0;
+        lane->waiting = same ? 0 : lane->waiting + 1;
+    }
+
+    // Decode stage of each lane: $imm, the register snapshot of the trace and the first cycle of bigimm
+    for (int l = 0; l < group->lane_num; l++) {
+        if (mask[l]) {
+            group->regs[REG_IMM][l] = decoded.immediate;
+            gather_registers(group, l, &snapshots[l]);
+            if (decoded.is_bigimm) {
+                machine_cycle(&group->lanes[l].machine);
+            }
+        }
+    }
+
+    // ALU ops and compares run on all lanes at once, the rest lane by lane
+    const int32_t* a = group->regs[decoded.rs];
+    const int32_t* b = group->regs[decoded.rt];
+    if (decoded.opcode >= OP_ADD && decoded.opcode <= OP_SRL) {
+        alu_lanes(decoded.opcode, result, a, b);
+        if (decoded.rd != REG_ZERO && decoded.rd != REG_IMM) {
+            int32_t* d = group->regs[decoded.rd];
+            for (int l = 0; l < LOCKSTEP_MAX_LANES; l++) {
+                d[l] = (result[l] & mask[l]) | (d[l] & ~mask[l]);
+            }
+        }
+        for (int l = 0; l < group->lane_num; l++) {
+            if (mask[l]) {
+                group->lanes[l].machine.pc = next_pc;
+            }
+        }
+    }
+    else if (decoded.opcode >= OP_BEQ && decoded.opcode <= OP_BGE) {
+        compare_lanes(decoded.opcode, result, a, b);
+        for (int l = 0; l < group->lane_num; l++) {
+            if (mask[l]) {
+                group->lanes[l].machine.pc = result[l] ? group->regs[decoded.rd][l] : next_pc;
+            }
+        }
+    }
+    else {
+        for (int l = 0; l < group->lane_num; l++) {
+            if (mask[l]) {
+                execute_lane(group, l, &decoded, pc, next_pc);
+            }
+        }
+    }
+
+    // Last cycle, trace, timer, disk, interrupts and devices of each lane
+    for (int l = 0; l < group->lane_num; l++) {
+        if (mask[l]) {
+            machine_finish(&group->lanes[l].machine, pc, instruction, &snapshots[l]);
+        }
+    }
+    return 1;
+}
+
+// Writes the output files of a lane that halted, like run_program
+static void write_lane_outputs(LaneGroup* group, int index) {
+    Lane* lane = &group->lanes[index];
+    Registers registers;
+
+    // Add the timer to the clock cycles
+    lane->io_registers.IORegistersArray[CLKS] += lane->disk.timer;
+    machine_close_files(&lane->machine);
+    gather_registers(group, index, &registers);
+    write_memory_out(lane->files[3], &lane->memory, IMAGE_DENSE);
+    disk_finish(&lane->disk);
+    write_registers_to_file(lane->files[4], &registers);
+    write_monitor_text(&lane->monitor, lane->files[11]);
+    write_yuv(&lane->monitor, lane->files[12]);
+    write_total_cycles(lane->files[7], &lane->io_registers);
+    free(lane->irq2.events_array);
+    memory_free(&lane->memory);
+}
+
+// Worker thread: takes the next group of jobs and runs it until all its lanes halted
+static int sweep_worker(void* argument) {
+    Sweep* sweep = argument;
+    LaneGroup* group = malloc(sizeof(LaneGroup));
+    Lane* lanes = malloc(LOCKSTEP_MAX_LANES * sizeof(Lane));
+    if (!group || !lanes) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    group->lanes = lanes;
+
+    for (;;) {
+        mtx_lock(&sweep->lock);
+        int first = sweep->next_job;
+        sweep->next_job += sweep->lane_num;
+        mtx_unlock(&sweep->lock);
+        if (first >= sweep->job_num) {
+            break;
+        }
+
+        int failed = 0;
+        group->lane_num = sweep->job_num - first < sweep->lane_num ? sweep->job_num - first : sweep->lane_num;
+        for (int l = 0; l < group->lane_num; l++) {
+            if (setup_lane(group, l, &sweep->files[(first + l) * 13]) != 0) {
+                group->lanes[l].failed = 1;
+                group->lanes[l].io_registers.halt = 0;
+                failed++;
+            }
+        }
+        while (step_group(group)) {
+        }
+        for (int l = 0; l < group->lane_num; l++) {
+            if (!group->lanes[l].failed) {
+                write_lane_outputs(group, l);
+            }
+        }
+
+        mtx_lock(&sweep->lock);
+        sweep->failed += failed;
+        mtx_unlock(&sweep->lock);
+    }
+    free(lanes);
+    free(group);
+    return 0;
+}
+
+// sim sweep [-lanes N] [-j threads] <jobs_file>
+int run_sweep(int argc, char* argv[]) {
+    Sweep sweep;
+    int thread_num = 1;
+    int valid = 1;
+    const char* jobs_file = NULL;
+
+    memset(&sweep, 0, sizeof(Sweep));
+    sweep.lane_num = LOCKSTEP_DEFAULT_LANES;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-lanes") == 0 && i + 1 < argc) {
+            sweep.lane_num = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_num = atoi(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && !jobs_file) {
+            jobs_file = argv[i];
+        }
+        else {
+            valid = 0;
+        }
+    }
+    if (!valid || !jobs_file || sweep.lane_num < 1 || sweep.lane_num > LOCKSTEP_MAX_LANES || thread_num < 1) {
+        printf("Usage: %s sweep [-lanes 1-%d] [-j threads] <jobs_file>\n", argv[0], LOCKSTEP_MAX_LANES);
+        printf("Each line of the jobs file has the 13 files of one run: memin diskin irq2in memout regout trace hwregtrace cycles leds display7seg diskout monitor.txt monitor.yuv\n");
+        return 1;
+    }
+    if (read_sweep_jobs(&sweep, jobs_file) != 0) {
+        return 1;
+    }
+
+    // One thread per group at most
+    int group_num = (sweep.job_num + sweep.lane_num - 1) / sweep.lane_num;
+    if (thread_num > group_num) {
+        thread_num = group_num > 0 ? group_num : 1;
+    }
+    thrd_t* threads = malloc((size_t)thread_num * sizeof(thrd_t));
+    if (!threads || mtx_init(&sweep.lock, mtx_plain) != thrd_success) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    int started = 0;
+    for (; started < thread_num; started++) {
+        if (thrd_create(&threads[started], sweep_worker, &sweep) != thrd_success) {
+            break;
+        }
+    }
+    // Work on the calling thread too if no thread could be started
+    if (started == 0) {
+        sweep_worker(&sweep);
+    }
+    for (int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    mtx_destroy(&sweep.lock);
+    free(threads);
+
+    printf("Simulated %d of %d instances\n", sweep.job_num - sweep.failed, sweep.job_num);
+    for (int i = 0; i < sweep.job_num * 13; i++) {
+        free(sweep.files[i]);
+    }
+    free(sweep.files);
+    return sweep.failed;
+}
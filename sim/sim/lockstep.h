@@ -0,0 +1,18 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "machine.h"
+
+// LOCKSTEP DEFINITIONS
+#define LOCKSTEP_MAX_LANES 16
+#define LOCKSTEP_DEFAULT_LANES 8
+#define LOCKSTEP_STARVE_LIMIT 256   // Steps a lane may wait for the other lanes before it runs alone
+
+// sim sweep [-lanes N] [-j threads] <jobs_file>
+// Runs many instances of a program, e.g. one memin with many diskin, irq2in and data variants.
+// Each line of the jobs file has the 13 files of the sim command line for one instance. The instances
+// run in lockstep groups of N lanes: an instruction is decoded once and its ALU op or compare runs on
+// all lanes at that pc in one loop over registers stored struct-of-arrays. Each lane keeps its own
+// memory, devices, interrupts and output files. Returns the number of instances that failed
+int run_sweep(int argc, char* argv[]);
+#endif
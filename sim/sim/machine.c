@@ -0,0 +1,238 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "machine.h"
+#include "fe_de_ex.h"
+#include "stats.h"
+#include "memprofile.h"
+
+// MACHINE FUNCTIONS
+
+
+// Write to display7seg file
+void write_to_display7seg_file(FILE* display7seg_file, const IORegisters* io, int32_t* last_display7seg) {
+    // Print to file if the register has changed
+    if (*last_display7seg != io->IORegistersArray[DISPLAY7SEG])
+    {
+        fprintf(display7seg_file, "%08X %08X\n", io->IORegistersArray[CLKS] - 1, io->IORegistersArray[DISPLAY7SEG]);
+        // Update the last_display7seg to the new one
+        *last_display7seg = io->IORegistersArray[DISPLAY7SEG];
+    }
+}
+
+// Writes a number in hex with at least min_digits digits, like %0*X. Returns the end of the text
+static char* format_hex(char* out, uint32_t value, int min_digits) {
+    static const char digits[] = "0123456789ABCDEF";
+    char reversed[8];
+    int length = 0;
+    do {
+        reversed[length++] = digits[value & 0xF];
+        value >>= 4;
+    } while (value != 0);
+    for (int i = length; i < min_digits; i++) {
+        *out++ = '0';
+    }
+    while (length > 0) {
+        *out++ = reversed[--length];
+    }
+    return out;
+}
+
+// Write the current line to simulator trace file. The line is formatted in a buffer and written at once,
+// the trace has a line for every instruction
+void write_to_trace_file(FILE* file, int32_t cycle, int32_t pc, int32_t instruction, const Registers* registers, const SymbolMap* map) {
+    char line[192];
+    char* end = line;
+
+    end = format_hex(end, (uint32_t)cycle, 8);
+    *end++ = ' ';
+    end = format_hex(end, (uint32_t)pc, 3);
+    *end++ = ' ';
+    end = format_hex(end, (uint32_t)instruction, 8);
+    // Go over Registers and print them
+    for (int i = 0; i <= 15; i++) {
+        *end++ = ' ';
+        end = format_hex(end, (uint32_t)registers->regs[i], 8);
+    }
+    fwrite(line, 1, (size_t)(end - line), file);
+    // Add the label and source line of the pc
+    if (map) {
+        char location[256];
+        format_location(map, pc, location, sizeof(location));
+        if (location[0]) {
+            fprintf(file, " ; %s", location);
+        }
+    }
+    fputc('\n', file);
+}
+
+// Write to leds file
+void write_to_leds_file(FILE* leds_file, const IORegisters* io_registers, uint32_t* last_leds) {
+    // Print to file if the register has changed
+    if (*last_leds != (uint32_t)io_registers->IORegistersArray[LEDS])
+    {
+        fprintf(leds_file, "%08X %08X\n", io_registers->IORegistersArray[CLKS] - 1, io_registers->IORegistersArray[LEDS]);
+        // Update the last_leds to the new one
+        *last_leds = io_registers->IORegistersArray[LEDS];
+    }
+}
+
+// Writes the registers values
+void write_registers_to_file(const char* filename, const Registers* registers) {
+    FILE* file = fopen(filename, "w");
+    // if file is valid
+    if (file)
+    {
+        // Go over the registers from 2 to 15 and print the values to file
+        for (int i = 2; i <= 15; i++) {
+            fprintf(file, "%08X\n", registers->regs[i]);
+        }
+        fclose(file);
+    }
+}
+
+// Opens the output files of the machine
+int machine_open_files(Machine* machine, const char* trace_filename, const char* hwregtrace_filename, const char* leds_filename, const char* display7seg_filename) {
+    machine->display7seg_file = fopen(display7seg_filename, "w");
+    machine->trace_file = fopen(trace_filename, "w");
+    machine->hwregtrace_file = fopen(hwregtrace_filename, "w");
+    machine->leds_file = fopen(leds_filename, "w");
+    if (!machine->display7seg_file || !machine->trace_file || !machine->hwregtrace_file || !machine->leds_file) {
+        machine_close_files(machine);
+        return -1;
+    }
+    return 0;
+}
+
+// Closes the files of the machine
+void machine_close_files(Machine* machine) {
+    FILE* files[4] = { machine->display7seg_file, machine->trace_file, machine->hwregtrace_file, machine->leds_file };
+    for (int i = 0; i < 4; i++) {
+        if (files[i]) {
+            fclose(files[i]);
+        }
+    }
+    machine->display7seg_file = NULL;
+    machine->trace_file = NULL;
+    machine->hwregtrace_file = NULL;
+    machine->leds_file = NULL;
+}
+
+// One clock cycle: checks for IRQ2 and increases the clock
+void machine_cycle(Machine* machine) {
+    machine->cycles++;
+    check_irq2(machine->io_registers, machine->irq2, machine->io_registers->IORegistersArray[CLKS]);
+    increase_clock(machine->io_registers);
+}
+
+// Everything that follows the execution of an instruction
+void machine_finish(Machine* machine, int32_t pc, int32_t instruction, const Registers* snapshot) {
+    IORegisters* io_registers = machine->io_registers;
+
+    // Last cycle of the instruction. The files are NULL in runs without output files, e.g. in the fuzzer
+    machine_cycle(machine);
+    if (machine->trace_file) {
+        write_to_trace_file(machine->trace_file, io_registers->IORegistersArray[CLKS] - 1, pc, instruction, snapshot, machine->map);
+    }
+
+    // Note what the devices are about to do for -stats
+    int events = machine->stats ? stats_before_devices(machine) : 0;
+
+    // Update timer
+    update_timer(io_registers);
+    // The other cores write the disk and monitor registers of core 0
+    int lock = machine->device_lock && machine->core == 0;
+    if (lock) {
+        mtx_lock(machine->device_lock);
+    }
+    // Process
+    if (machine->profile) {
+        profile_disk(machine->profile, io_registers);
+    }
+    Process_disk_command(machine->memory, io_registers, machine->disk);
+    //check for all interrupts
+    handle_all_interrupts(io_registers, &machine->pc, &machine->in_interrupt);
+
+    // if needed write to monitor
+    if (io_registers->IORegistersArray[MONITORCMD] == 1) {
+        write_pixel(machine->monitor, io_registers);
+    }
+    if (lock) {
+        mtx_unlock(machine->device_lock);
+    }
+    if (machine->stats) {
+        stats_after_devices(machine->stats, machine, events);
+    }
+    // Write to leds
+    if (machine->leds_file) {
+        write_to_leds_file(machine->leds_file, io_registers, &machine->last_leds);
+    }
+    // Write to display7seg
+    if (machine->display7seg_file) {
+        write_to_display7seg_file(machine->display7seg_file, io_registers, &machine->last_display7seg);
+    }
+}
+
+// Fetch, decode and execute one instruction
+void machine_step(Machine* machine) {
+    int32_t current_pc = machine->pc;
+    uint64_t first_cycle = machine->cycles;
+    int started_in_interrupt = machine->in_interrupt;
+    int disk_busy = machine->io_registers->IORegistersArray[DISKSTATUS] == 1;
+    Instruction decoded;
+
+    // Fetch the instruction
+    int8_t instruction_line[4];
+    if (!read_instruction_from_memory(machine->memory, current_pc, instruction_line)) {
+        printf("Error: The pc %d is outside of the memory\n", current_pc);
+        machine->io_registers->halt = 0;
+        return;
+    }
+    int32_t instruction = (int32_t)((uint32_t)(uint8_t)instruction_line[0] << 24 | (uint32_t)(uint8_t)instruction_line[1] << 16 |
+        (uint32_t)(uint8_t)instruction_line[2] << 8 | (uint8_t)instruction_line[3]);
+
+    // Decode the instruction
+    instruction_decode(instruction_line, &decoded, current_pc, machine->memory, machine->registers);
+
+    // Snapshot the register state
+    Registers snapshot_registers = *machine->registers;
+    if (machine->stats) {
+        stats_count_instruction(machine->stats, &decoded, &snapshot_registers);
+    }
+    // Memory accesses for -heatmap and -cache, a cache miss stalls for the miss cycles
+    int stall_cycles = 0;
+    if (machine->profile && (decoded.opcode == OP_LW || decoded.opcode == OP_SW)) {
+        int32_t address = (int32_t)((uint32_t)snapshot_registers.regs[decoded.rs] + (uint32_t)snapshot_registers.regs[decoded.rt]);
+        stall_cycles = profile_access(machine->profile, address, decoded.opcode == OP_SW);
+    }
+
+    // Handle instruction (bigimm needs 2 cycles)
+    if (decoded.is_bigimm) {
+        machine_cycle(machine); // 1st cycle
+    }
+    // in and out may use the disk and monitor registers of core 0
+    int lock = machine->device_lock && (decoded.opcode == OP_IN || decoded.opcode == OP_OUT);
+    if (lock) {
+        mtx_lock(machine->device_lock);
+    }
+    instruction_execute(&decoded, machine->registers, &machine->pc, machine->memory, &machine->in_interrupt, machine->hwregtrace_file, machine->io_registers);
+    if (lock) {
+        mtx_unlock(machine->device_lock);
+    }
+    for (; stall_cycles > 0; stall_cycles--) {
+        machine_cycle(machine);
+    }
+    machine_finish(machine, current_pc, instruction, &snapshot_registers);
+
+    // Cycles in and out of the interrupt handlers and while the disk is busy
+    if (machine->stats) {
+        uint64_t cycles = machine->cycles - first_cycle;
+        if (started_in_interrupt) {
+            machine->stats->interrupt_cycles += cycles;
+        }
+        else {
+            machine->stats->main_cycles += cycles;
+        }
+        if (disk_busy) {
+            machine->stats->disk_busy_cycles += cycles;
+        }
+    }
+}
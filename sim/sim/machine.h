@@ -0,0 +1,59 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+#include "data.h"
+#include "symbols.h"
+
+// State of a running SIMP machine and the output files of the run
+typedef struct {
+    Registers* registers;
+    Memory* memory;
+    IORegisters* io_registers;
+    IRQ2Data* irq2;
+    Monitor* monitor;
+    Disk* disk;
+    int32_t pc;
+    int in_interrupt;           // 0 = not in interrupt, 1 = in interrupt
+    FILE* trace_file;
+    FILE* hwregtrace_file;
+    FILE* leds_file;
+    FILE* display7seg_file;
+    const SymbolMap* map;       // Symbol map for the trace, NULL without -map
+    int core;                   // Number of the core in a multi-core run, 0 otherwise
+    mtx_t* device_lock;         // Lock of the shared disk and monitor registers when the cores run on threads, NULL otherwise
+    uint64_t cycles;            // Cycles the machine ran, counts the quanta of a multi-core run
+    uint32_t last_leds;         // Last values written to the leds and display7seg files
+    int32_t last_display7seg;
+    struct SimStats* stats;     // Counters for -stats, NULL without
+    struct MemoryProfile* profile; // Memory access counts and cache model for -heatmap and -cache, NULL without
+} Machine;
+
+// Write to display7seg file
+void write_to_display7seg_file(FILE* display7seg_file, const IORegisters* io, int32_t* last_display7seg);
+// Write the current line to simulator trace file
+void write_to_trace_file(FILE* file, int32_t cycle, int32_t pc, int32_t instruction, const Registers* registers, const SymbolMap* map);
+// Write to leds file
+void write_to_leds_file(FILE* leds_file, const IORegisters* io_registers, uint32_t* last_leds);
+// Writes the registers values
+void write_registers_to_file(const char* filename, const Registers* registers);
+
+// Opens the trace, hwregtrace, leds and display7seg files of the machine, returns 0 on success
+int machine_open_files(Machine* machine, const char* trace_filename, const char* hwregtrace_filename, const char* leds_filename, const char* display7seg_filename);
+// Closes the files of the machine
+void machine_close_files(Machine* machine);
+
+// One clock cycle: checks for IRQ2 and increases the clock
+void machine_cycle(Machine* machine);
+// Everything that follows the execution of an instruction: the last cycle, the trace, the timer, the disk,
+// the interrupts and the devices. snapshot has the registers after the decode
+void machine_finish(Machine* machine, int32_t pc, int32_t instruction, const Registers* snapshot);
+// Fetch, decode and execute one instruction
+void machine_step(Machine* machine);
+
+// Runs the program translated by simp2c until it halts or the interpreter has to take over,
+// e.g. after the program wrote into its own code. Only in builds with SIMP_TRANSLATED
+void translated_run(Machine* machine);
+#endif
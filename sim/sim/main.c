@@ -3,203 +3,104 @@
 #include <stdlib.h>    
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "fe_de_ex.h"
 #include "data.h"    
-
-
+#include "symbols.h"
+#include "machine.h"
+#include "multicore.h"
+#include "lockstep.h"
+#include "fuzz.h"
+#include "stats.h"
+#include "memprofile.h"
+#include "diskio.h"
+#include "../../asm/asm/simp_asm.h"
+
+
+
+// Options given before the files on the command line
+typedef struct {
+    int optimize;               // -O: optimize the program in run mode
+    const char* map_filename;   // -map file: symbol map from asm -g, adds label+offset and source line to the trace
+    int memout_format;          // -s / -b: write memout as a sparse text or binary image
+    CoreOptions cores;          // -cores N, -quantum K, -det: run N cores that share the memory
+    const char* stats_filename; // -stats file.json: write the execution statistics
+    ProfileOptions profile;     // -heatmap file, -cache size,line,ways[,miss]: memory access counts and cache model
+    int address_bits;           // -addrbits N: memory of 2^N words, 12 by default
+} SimOptions;
 
 // MAIN PROGRAM FUNCTIONS
 
-// Write to display7seg file
-void write_to_display7seg_file(FILE* display7seg_file, const IORegisters* io) {
-    static int32_t last_display7seg = 0;
-
-    // Print to file if the register has changed
-    if (last_display7seg != io->IORegistersArray[DISPLAY7SEG])
-    {
-        fprintf(display7seg_file, "%08X %08X\n", io->IORegistersArray[CLKS] - 1, io->IORegistersArray[DISPLAY7SEG]);
-        // Update the last_display7seg to the new one
-        last_display7seg = io->IORegistersArray[DISPLAY7SEG];
-    }
-}
-
-// Write the current line to simulator trace file
-void write_to_trace_file(FILE* file, int32_t cycle, int16_t pc, const int8_t* instruction_line, const Registers* registers) {
-    fprintf(file, "%08X ", cycle);
-    fprintf(file, "%03X ", pc);
-    // Go over line and print instructions
-    for (int i = 0; i < 4; i++) {
-        fprintf(file, "%02X", (uint8_t)instruction_line[i]);
-    }
-    fprintf(file, " ");
-    // Go over Registers and print them
-    for (int i = 0; i <= 15; i++) {
-        fprintf(file, "%08X", registers->regs[i]);
-        if (i < 15) {
-            fprintf(file, " ");
-        }
-    }
-    fprintf(file, "\n");
-}
-
-// Write to leds file
-void write_to_leds_file(FILE* leds_file, const IORegisters* io_registers) {
-    static uint32_t last_leds = 0;
-
-    // Print to file if the register has changed
-    if (last_leds != io_registers->IORegistersArray[LEDS])
-    {
-        fprintf(leds_file, "%08X %08X\n", io_registers->IORegistersArray[CLKS] - 1, io_registers->IORegistersArray[LEDS]);
-        // Update the last_leds to the new one
-        last_leds = io_registers->IORegistersArray[LEDS];
-    }
-}
-
 // fetch-decode-execute
-void fetch_decode_execute(Registers* registers, Memory* memory, IORegisters* io_registers, IRQ2Data* irq2, Monitor* monitor, Disk* disk, const char* diskout_filename, const char* trace_filename, const char* hwregtrace_filename, const char* leds_filename, const char* display7seg_filename) {
-    int16_t pc = 0;
-    int in_interrupt = 0;   // 0 = not in interrupt, 1 = in interrupt
-    Instruction decoded;
-
-    // Open files
-    FILE* display7seg_file = fopen(display7seg_filename, "w");
-    if (!display7seg_file) {
-        return;
-    }
-    FILE* trace_file = fopen(trace_filename, "w");
-    if (!trace_file) {
-        fclose(display7seg_file);
-        return;
-    }
-
-    FILE* hwregtrace_file = fopen(hwregtrace_filename, "w");
-    if (!hwregtrace_file) {
-        fclose(display7seg_file);
-        fclose(trace_file);
+void fetch_decode_execute(Registers* registers, Memory* memory, IORegisters* io_registers, IRQ2Data* irq2, Monitor* monitor, Disk* disk, const char* diskout_filename, const char* trace_filename, const char* hwregtrace_filename, const char* leds_filename, const char* display7seg_filename, const SymbolMap* map, SimStats* stats, MemoryProfile* profile) {
+    Machine machine;
+    memset(&machine, 0, sizeof(Machine));
+    machine.registers = registers;
+    machine.memory = memory;
+    machine.io_registers = io_registers;
+    machine.irq2 = irq2;
+    machine.monitor = monitor;
+    machine.disk = disk;
+    machine.map = map;
+    machine.stats = stats;
+    machine.profile = profile;
+    if (machine_open_files(&machine, trace_filename, hwregtrace_filename, leds_filename, display7seg_filename) != 0) {
         return;
     }
 
-    FILE* leds_file = fopen(leds_filename, "w");
-    if (!leds_file) {
-        fclose(display7seg_file);
-        fclose(trace_file);
-        fclose(hwregtrace_file);
-        return;
-    }
-
-
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+#ifdef SIMP_TRANSLATED
+    // The program was translated to C by simp2c, the interpreter continues where the translation stops
+    translated_run(&machine);
+#endif
     while (io_registers->halt) {
-        int16_t current_pc = pc;
-
-        // Fetch the instruction
-        const int8_t* instr_bytes = read_instruction_from_memory(memory, current_pc);
-
-        // Make a copy to avoid pointer issues
-        int8_t instruction_line[4];
-        memcpy(instruction_line, instr_bytes, 4);
-
-        // Decode the instruction
-        instruction_decode(instruction_line, &decoded, current_pc, memory, registers);
-
-        // Snapshot the register state
-        Registers snapshot_registers = *registers;
-
-        // Handle instruction (bigimm needs 2 cycles)
-        if (decoded.is_bigimm) {
-            check_irq2(io_registers, irq2, io_registers->IORegistersArray[CLKS]);
-            increase_clock(io_registers); // 1st cycle
-            instruction_execute(&decoded, registers, &pc, memory, &in_interrupt, hwregtrace_file, io_registers);
-            check_irq2(io_registers, irq2, io_registers->IORegistersArray[CLKS]);
-            increase_clock(io_registers); // 2nd cycle
-            // Write to trace file the first word of bigimm
-            write_to_trace_file(trace_file, io_registers->IORegistersArray[CLKS] - 1, current_pc, instruction_line, &snapshot_registers);
-        }
-        else {
-            // no Bigimm
-            instruction_execute(&decoded, registers, &pc, memory, &in_interrupt, hwregtrace_file, io_registers);
-            check_irq2(io_registers, irq2, io_registers->IORegistersArray[CLKS]);
-            increase_clock(io_registers);
-            write_to_trace_file(trace_file, io_registers->IORegistersArray[CLKS] - 1, current_pc, instruction_line, &snapshot_registers);
-        }
-
-        // Update timer
-        update_timer(io_registers);
-        // Process
-        Process_disk_command(memory, io_registers, disk);
-        //check for all interrupts
-        handle_all_interrupts(io_registers, &pc, &in_interrupt);
-
-        // if needed write to monitor
-        if (io_registers->IORegistersArray[MONITORCMD] == 1) {
-            write_pixel(monitor, io_registers);
-        }
-        // Write to leds
-        write_to_leds_file(leds_file, io_registers);
-        // Write to display7seg
-        write_to_display7seg_file(display7seg_file, io_registers);
+        machine_step(&machine);
+    }
+    timespec_get(&end, TIME_UTC);
+    if (stats) {
+        stats->wall_seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
     }
 
     // Add the timer to the clock cycles
     io_registers->IORegistersArray[CLKS] += disk->timer;
 
     // Close files
-    fclose(display7seg_file);
-    fclose(trace_file);
-    fclose(hwregtrace_file);
-    fclose(leds_file);
-}
-
-// Writes the registers values
-void write_registers_to_file(const char* filename, const Registers* registers) {
-    FILE* file = fopen(filename, "w");
-    // if file is valid
-    if (file)
-    {
-        // Go over the registers from 2 to 15 and print the values to file
-        for (int i = 2; i <= 15; i++) {
-            fprintf(file, "%08X\n", registers->regs[i]);
-        }
-        fclose(file);
-    }
+    machine_close_files(&machine);
 }
 
-int main(int argc, char* argv[]) {
-    // check if the number of input files is valid
-    if (argc != 14) {
-        return 0;
-    }
-
-    // Get all input and output files
-    const char* memin = argv[1];      // Instruction memory input file
-    const char* diskin = argv[2];      // Disk content input file
-    const char* irq2in = argv[3];      // IRQ2 events input file
-    const char* memout = argv[4];     // Data memory output file
-    const char* regout = argv[5];      // Registers output file
-    const char* trace = argv[6];       // Instruction trace output file
-    const char* hwregtrace = argv[7];  // Hardware register trace output file
-    const char* cycles = argv[8];      // Clock cycle count output file
-    const char* leds = argv[9];       // LED state output file
-    const char* display7seg = argv[10];// 7-segment display output file
-    const char* diskout = argv[11];    // Disk content output file
-    const char* monitor_txt = argv[12];// Monitor text output file
-    const char* monitor_yuv = argv[13];// Monitor YUV binary output file
+// Runs the program that is loaded in memory and writes all the output files.
+// files has the 13 files of the command line, files[0] (memin) is not used here
+void run_program(Memory* memory, const char* files[], const SimOptions* options) {
+    const char* diskin = files[1];      // Disk content input file
+    const char* irq2in = files[2];      // IRQ2 events input file
+    const char* memout = files[3];     // Data memory output file
+    const char* regout = files[4];      // Registers output file
+    const char* trace = files[5];       // Instruction trace output file
+    const char* hwregtrace = files[6];  // Hardware register trace output file
+    const char* cycles = files[7];      // Clock cycle count output file
+    const char* leds = files[8];       // LED state output file
+    const char* display7seg = files[9];// 7-segment display output file
+    const char* diskout = files[10];    // Disk content output file
+    const char* monitor_txt = files[11];// Monitor text output file
+    const char* monitor_yuv = files[12];// Monitor YUV binary output file
 
     // call init of registers
     Registers registers;
     registers_init(&registers);
 
-    // call init of data memory
-    Memory memory;
-    memory_init(&memory);
-    load_instruction(memin, &memory);
-
     // call init of io registers
     IORegisters io_registers;
     io_init(&io_registers);
+    io_registers.address_bits = memory->address_bits;
 
     // call init of diskout
     Disk disk;
     disk_init(diskin, diskout, &disk);
+    // The sector reads of a single core run go to an I/O thread, the cores of a multi-core run share the memory
+    if (options->cores.core_num <= 1) {
+        disk_io_start(&disk);
+    }
 
     // call init of monitor
     Monitor monitor;
@@ -209,14 +110,186 @@ int main(int argc, char* argv[]) {
     IRQ2Data irq2;
     load_irq2(irq2in, &irq2);
 
-    // Call the fetch_decode_execute loop
-    fetch_decode_execute(&registers, &memory, &io_registers, &irq2, &monitor, &disk, diskout, trace, hwregtrace, leds, display7seg);
+    // Load the symbol map if there is one
+    SymbolMap* map = NULL;
+    if (options->map_filename) {
+        map = malloc(sizeof(SymbolMap));
+        if (map && load_symbol_map(options->map_filename, map) != 0) {
+            printf("Error: Could not load symbol map '%s'.\n", options->map_filename);
+            free(map);
+            map = NULL;
+        }
+    }
+
+    // Call the fetch_decode_execute loop, a multi-core run writes the registers, cycles, stats and heatmap of each core
+    if (options->cores.core_num > 1) {
+        run_cores(memory, &disk, &monitor, &irq2, files, &options->cores, map, options->stats_filename, &options->profile);
+    }
+    else {
+        SimStats* stats = NULL;
+        if (options->stats_filename) {
+            stats = calloc(1, sizeof(SimStats));
+            if (!stats) {
+                printf("Error: Out of memory\n");
+                exit(1);
+            }
+        }
+        MemoryProfile* profile = profile_create(&options->profile, memory->depth);
+        fetch_decode_execute(&registers, memory, &io_registers, &irq2, &monitor, &disk, diskout, trace, hwregtrace, leds, display7seg, map, stats, profile);
+        write_registers_to_file(regout, &registers);
+        write_total_cycles(cycles, &io_registers);
+        if (stats) {
+            write_stats_file(options->stats_filename, stats, &io_registers, &irq2);
+            free(stats);
+        }
+        if (profile) {
+            profile_write(profile, options->profile.heatmap_filename);
+            profile_free(profile);
+        }
+    }
+    if (map) {
+        free_symbol_map(map);
+        free(map);
+    }
 
-    // Write all output files
-    write_memory_out(memout, &memory);
-    write_registers_to_file(regout, &registers);
+    // Write all output files, a disk read that is still running goes to memory first
+    disk_io_stop(&disk, memory);
+    write_memory_out(memout, memory, options->memout_format);
+    disk_finish(&disk);
     write_monitor_text(&monitor, monitor_txt);
     write_yuv(&monitor, monitor_yuv);
-    write_total_cycles(cycles, &io_registers);
+}
+
+// Reads the options that come before the files. Returns the index of the first file, or -1 on an unknown option
+int parse_options(int argc, char* argv[], int first, SimOptions* options) {
+    memset(options, 0, sizeof(SimOptions));
+    options->address_bits = DEFAULT_ADDRESS_BITS;
+    for (; first < argc && argv[first][0] == '-'; first++) {
+        if (strcmp(argv[first], "-O") == 0) {
+            options->optimize = 1;
+        }
+        else if (strcmp(argv[first], "-s") == 0) {
+            options->memout_format = IMAGE_SPARSE;
+        }
+        else if (strcmp(argv[first], "-b") == 0) {
+            options->memout_format = IMAGE_BINARY;
+        }
+        else if (strcmp(argv[first], "-map") == 0 && first + 1 < argc) {
+            options->map_filename = argv[++first];
+        }
+        else if (strcmp(argv[first], "-cores") == 0 && first + 1 < argc) {
+            options->cores.core_num = atoi(argv[++first]);
+            if (options->cores.core_num < 1 || options->cores.core_num > MAX_CORES) {
+                printf("Error: The number of cores must be 1 to %d.\n", MAX_CORES);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[first], "-quantum") == 0 && first + 1 < argc) {
+            options->cores.quantum = atoi(argv[++first]);
+            if (options->cores.quantum < 1) {
+                printf("Error: The quantum must be at least 1 cycle.\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[first], "-stats") == 0 && first + 1 < argc) {
+            options->stats_filename = argv[++first];
+        }
+        else if (strcmp(argv[first], "-heatmap") == 0 && first + 1 < argc) {
+            options->profile.heatmap_filename = argv[++first];
+        }
+        else if (strcmp(argv[first], "-cache") == 0 && first + 1 < argc) {
+            if (parse_cache_option(argv[++first], &options->profile) != 0) {
+                return -1;
+            }
+        }
+        else if (strcmp(argv[first], "-addrbits") == 0 && first + 1 < argc) {
+            options->address_bits = atoi(argv[++first]);
+            if (options->address_bits < DEFAULT_ADDRESS_BITS || options->address_bits > MAX_ADDRESS_BITS) {
+                printf("Error: The address width must be %d to %d bits.\n", DEFAULT_ADDRESS_BITS, MAX_ADDRESS_BITS);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[first], "-det") == 0) {
+            options->cores.deterministic = 1;
+        }
+        else {
+            printf("Error: Unknown option '%s'.\n", argv[first]);
+            return -1;
+        }
+    }
+    return first;
+}
+
+// sim run [options] program.asm [diskin irq2in memout ... monitor.yuv]
+// Assembles the program in process and loads it straight into memory, without a memin file.
+// The 12 files after the program are optional, the default names are used without them
+int run_source(int argc, char* argv[]) {
+    const char* files[13] = { NULL, "diskin.txt", "irq2in.txt", "memout.txt", "regout.txt", "trace.txt", "hwregtrace.txt",
+        "cycles.txt", "leds.txt", "display7seg.txt", "diskout.txt", "monitor.txt", "monitor.yuv" };
+    SimOptions options;
+    int first = parse_options(argc, argv, 2, &options);
+
+    if (first < 0 || (argc - first != 1 && argc - first != 13)) {
+        printf("Usage: %s run [-O] [-s|-b] [-map file.map] [-stats file.json] [-heatmap file] [-cache size,line,ways[,miss]] [-addrbits N] [-cores N [-quantum K] [-det]] <program.asm> [diskin irq2in memout regout trace hwregtrace cycles leds display7seg diskout monitor.txt monitor.yuv]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; first + i < argc; i++) {
+        files[i] = argv[first + i];
+    }
+
+    // The simulator needs the disk and IRQ2 input files
+    for (int i = 1; i <= 2; i++) {
+        FILE* file = fopen(files[i], "r");
+        if (!file) {
+            printf("Error: Could not open input file '%s'.\n", files[i]);
+            return 1;
+        }
+        fclose(file);
+    }
+
+    AssembledProgram program;
+    if (assemble_file(argv[first], options.optimize, &program) != 0) {
+        return 1;
+    }
+
+    Memory memory;
+    memory_init_width(&memory, options.address_bits);
+    load_words(&memory, program.words, program.word_num);
+    free_assembled_program(&program);
+
+    run_program(&memory, files, &options);
+    memory_free(&memory);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Assemble and run without a memin file
+    if (argc >= 2 && strcmp(argv[1], "run") == 0) {
+        return run_source(argc, argv);
+    }
+    // Run many instances of a program in lockstep groups
+    if (argc >= 2 && strcmp(argv[1], "sweep") == 0) {
+        return run_sweep(argc, argv);
+    }
+    // Explore IRQ2 arrival times against assertions on the final state
+    if (argc >= 2 && strcmp(argv[1], "fuzz") == 0) {
+        return run_fuzz(argc, argv);
+    }
+
+    // check if the number of input files is valid
+    SimOptions options;
+    int first = parse_options(argc, argv, 1, &options);
+    if (first < 0 || argc - first != 13) {
+        return 0;
+    }
+
+    // call init of data memory
+    Memory memory;
+    memory_init_width(&memory, options.address_bits);
+    load_instruction(argv[first], &memory);
+
+    // Get all input and output files, the first one is the instruction memory input file
+    run_program(&memory, (const char**)(argv + first), &options);
+    memory_free(&memory);
     return 0;
-}
\ No newline at end of file
+}
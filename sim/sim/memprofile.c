@@ -0,0 +1,262 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "memprofile.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MEMORY PROFILE FUNCTIONS
+
+#define HEATMAP_WIDTH 64    // The image of a .pgm heatmap has a row for every 64 addresses
+
+// Reads "size,line,ways[,miss]" of -cache
+int parse_cache_option(const char* text, ProfileOptions* options) {
+    int size = 0, line = 0, ways = 0, miss = 0;
+    int fields = sscanf(text, "%d,%d,%d,%d", &size, &line, &ways, &miss);
+
+    // The line size is a power of 2 and the cache has a whole number of sets
+    if (fields < 3 || size < 1 || line < 1 || (line & (line - 1)) != 0 || ways < 1 || miss < 0 ||
+        size % (line * ways) != 0) {
+        printf("Error: -cache needs size,line,ways[,miss] in words, e.g. 256,4,2,10. The size has to be a multiple of line * ways.\n");
+        return -1;
+    }
+    options->cache_words = size;
+    options->line_words = line;
+    options->ways = ways;
+    options->miss_cycles = miss;
+    return 0;
+}
+
+// Makes the profile of a run
+MemoryProfile* profile_create(const ProfileOptions* options, int depth) {
+    if (!options->heatmap_filename && options->cache_words == 0) {
+        return NULL;
+    }
+    MemoryProfile* profile = calloc(1, sizeof(MemoryProfile));
+    if (profile) {
+        profile->page_num = depth / PAGE_WORDS;
+        profile->pages = calloc((size_t)profile->page_num, sizeof(PageCounts*));
+    }
+    if (!profile || !profile->pages) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    if (options->cache_words > 0) {
+        CacheModel* cache = calloc(1, sizeof(CacheModel));
+        int way_num = options->cache_words / options->line_words;
+        if (!cache) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+        cache->ways = options->ways;
+        cache->set_num = way_num / options->ways;
+        cache->line_words = options->line_words;
+        cache->miss_cycles = options->miss_cycles;
+        cache->tags = malloc((size_t)way_num * sizeof(int32_t));
+        cache->used = calloc((size_t)way_num, sizeof(uint64_t));
+        if (!cache->tags || !cache->used) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+        for (int i = 0; i < way_num; i++) {
+            cache->tags[i] = -1;
+        }
+        profile->cache = cache;
+    }
+    return profile;
+}
+
+// Finds the counts of the page of an address, they are allocated on the first use
+static PageCounts* page_counts(MemoryProfile* profile, int address) {
+    PageCounts** counts = &profile->pages[address >> PAGE_BITS];
+    if (!*counts) {
+        *counts = calloc(1, sizeof(PageCounts));
+        if (!*counts) {
+            printf("Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    return *counts;
+}
+
+// Looks up a word in the cache and loads its line on a miss. Returns the extra cycles
+static int cache_access(CacheModel* cache, int address, int is_write) {
+    int32_t line = address / cache->line_words;
+    int first = (line % cache->set_num) * cache->ways;
+    int victim = first;
+
+    cache->time++;
+    for (int way = first; way < first + cache->ways; way++) {
+        if (cache->tags[way] == line) {
+            cache->used[way] = cache->time;
+            if (is_write) {
+                cache->write_hits++;
+            }
+            else {
+                cache->read_hits++;
+            }
+            return 0;
+        }
+        // An empty way was never used, so it goes first
+        if (cache->used[way] < cache->used[victim]) {
+            victim = way;
+        }
+    }
+    cache->tags[victim] = line;
+    cache->used[victim] = cache->time;
+    if (is_write) {
+        cache->write_misses++;
+    }
+    else {
+        cache->read_misses++;
+    }
+    cache->extra_cycles += (uint64_t)cache->miss_cycles;
+    return cache->miss_cycles;
+}
+
+// Counts a lw or sw
+int profile_access(MemoryProfile* profile, int address, int is_write) {
+    if (address < 0 || address >= profile->page_num * PAGE_WORDS) {
+        return 0;
+    }
+    PageCounts* counts = page_counts(profile, address);
+    if (is_write) {
+        counts->writes[address & (PAGE_WORDS - 1)]++;
+    }
+    else {
+        counts->reads[address & (PAGE_WORDS - 1)]++;
+    }
+    return profile->cache ? cache_access(profile->cache, address, is_write) : 0;
+}
+
+// Counts the disk DMA of a command that Process_disk_command is about to start
+void profile_disk(MemoryProfile* profile, const IORegisters* io_registers) {
+    const int32_t* io = io_registers->IORegistersArray;
+    int32_t command = io[DISKCMD];
+    if (io[DISKSTATUS] == 1 || (command != 1 && command != 2)) {
+        return;
+    }
+
+    for (int i = 0; i < LINES_PER_SECTOR; i++) {
+        int32_t address = io[DISKBUFFER] + i;
+        if (address < 0 || address >= profile->page_num * PAGE_WORDS) {
+            continue;
+        }
+        PageCounts* counts = page_counts(profile, address);
+        if (command == 2) {
+            counts->dma_reads[address & (PAGE_WORDS - 1)]++;
+            continue;
+        }
+        counts->dma_writes[address & (PAGE_WORDS - 1)]++;
+        // The words in the cache are old after the DMA
+        CacheModel* cache = profile->cache;
+        if (cache) {
+            int32_t line = address / cache->line_words;
+            int first = (line % cache->set_num) * cache->ways;
+            for (int way = first; way < first + cache->ways; way++) {
+                if (cache->tags[way] == line) {
+                    cache->tags[way] = -1;
+                    cache->used[way] = 0;
+                }
+            }
+        }
+    }
+}
+
+// Describes the cache and its results in one line
+static void format_cache(const CacheModel* cache, char* text, size_t size) {
+    uint64_t hits = cache->read_hits + cache->write_hits;
+    uint64_t accesses = hits + cache->read_misses + cache->write_misses;
+    snprintf(text, size, "Cache %d words, %d words per line, %d ways, %d cycles per miss: loads %llu hits %llu misses, stores %llu hits %llu misses, hit rate %.2f%%, %llu extra cycles",
+        cache->set_num * cache->ways * cache->line_words, cache->line_words, cache->ways, cache->miss_cycles,
+        (unsigned long long)cache->read_hits, (unsigned long long)cache->read_misses,
+        (unsigned long long)cache->write_hits, (unsigned long long)cache->write_misses,
+        accesses ? 100.0 * (double)hits / (double)accesses : 0.0, (unsigned long long)cache->extra_cycles);
+}
+
+// All the accesses of an address
+static uint64_t total_accesses(const MemoryProfile* profile, int address) {
+    const PageCounts* counts = profile->pages[address >> PAGE_BITS];
+    int i = address & (PAGE_WORDS - 1);
+    return counts ? counts->reads[i] + counts->writes[i] + counts->dma_reads[i] + counts->dma_writes[i] : 0;
+}
+
+// Writes the accesses of every address as a gray level, on a log scale up to the most used address.
+// The image ends after the last page that was used, it has at least the 4096 words of the default memory
+static void write_heatmap_image(const MemoryProfile* profile, FILE* file) {
+    uint64_t most = 0;
+    int depth = DATA_MEM_DEPTH;
+    for (int page = 0; page < profile->page_num; page++) {
+        if (profile->pages[page] && (page + 1) * PAGE_WORDS > depth) {
+            depth = (page + 1) * PAGE_WORDS;
+        }
+    }
+    for (int i = 0; i < depth; i++) {
+        uint64_t total = total_accesses(profile, i);
+        if (total > most) {
+            most = total;
+        }
+    }
+    fprintf(file, "P2\n%d %d\n255\n", HEATMAP_WIDTH, depth / HEATMAP_WIDTH);
+    for (int i = 0; i < depth; i++) {
+        uint64_t total = total_accesses(profile, i);
+        int level = most ? (int)(255.0 * log1p((double)total) / log1p((double)most) + 0.5) : 0;
+        fprintf(file, "%d%c", level, (i + 1) % HEATMAP_WIDTH ? ' ' : '\n');
+    }
+}
+
+// Writes the heatmap file and prints the cache results
+void profile_write(const MemoryProfile* profile, const char* filename) {
+    char cache_text[512];
+
+    if (profile->cache) {
+        format_cache(profile->cache, cache_text, sizeof(cache_text));
+        printf("%s\n", cache_text);
+    }
+    if (!filename) {
+        return;
+    }
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        printf("Error: Could not open heatmap file '%s'.\n", filename);
+        return;
+    }
+    size_t length = strlen(filename);
+    if (length >= 4 && strcmp(filename + length - 4, ".pgm") == 0) {
+        write_heatmap_image(profile, file);
+        fclose(file);
+        return;
+    }
+
+    // One line for every address that was used: address, lw, sw, words the disk read and wrote
+    if (profile->cache) {
+        fprintf(file, "# %s\n", cache_text);
+    }
+    fprintf(file, "# address reads writes dma_reads dma_writes\n");
+    for (int page = 0; page < profile->page_num; page++) {
+        const PageCounts* counts = profile->pages[page];
+        for (int i = 0; counts && i < PAGE_WORDS; i++) {
+            if (counts->reads[i] || counts->writes[i] || counts->dma_reads[i] || counts->dma_writes[i]) {
+                fprintf(file, "%03X %llu %llu %llu %llu\n", page * PAGE_WORDS + i, (unsigned long long)counts->reads[i],
+                    (unsigned long long)counts->writes[i], (unsigned long long)counts->dma_reads[i], (unsigned long long)counts->dma_writes[i]);
+            }
+        }
+    }
+    fclose(file);
+}
+
+// Frees the profile
+void profile_free(MemoryProfile* profile) {
+    if (!profile) {
+        return;
+    }
+    if (profile->cache) {
+        free(profile->cache->tags);
+        free(profile->cache->used);
+        free(profile->cache);
+    }
+    for (int page = 0; page < profile->page_num; page++) {
+        free(profile->pages[page]);
+    }
+    free(profile->pages);
+    free(profile);
+}
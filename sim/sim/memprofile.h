@@ -0,0 +1,62 @@
+#ifndef MEMPROFILE_H
+#define MEMPROFILE_H
+
+#include <stdint.h>
+#include "data.h"
+
+// MEMORY PROFILE DEFINITIONS
+
+// Options of -heatmap and -cache
+typedef struct {
+    const char* heatmap_filename;   // -heatmap file: access counts per address, an image 64 addresses wide for a .pgm file
+    int cache_words;                // -cache size,line,ways[,miss]: cache size in words, 0 without a cache model
+    int line_words;                 // Words per cache line
+    int ways;                       // Lines per set
+    int miss_cycles;                // Extra cycles of a miss, 0 only counts the hits and misses
+} ProfileOptions;
+
+// Set-associative data cache with LRU replacement. Stores allocate a line like loads
+typedef struct {
+    int set_num;
+    int ways;
+    int line_words;
+    int miss_cycles;
+    int32_t* tags;              // Line address of each way, -1 for an empty way
+    uint64_t* used;             // Time of the last access of each way
+    uint64_t time;
+    uint64_t read_hits;
+    uint64_t read_misses;
+    uint64_t write_hits;
+    uint64_t write_misses;
+    uint64_t extra_cycles;
+} CacheModel;
+
+// Access counts of the words of a memory page
+typedef struct {
+    uint64_t reads[PAGE_WORDS];         // lw
+    uint64_t writes[PAGE_WORDS];        // sw
+    uint64_t dma_reads[PAGE_WORDS];     // Words the disk writes to a sector
+    uint64_t dma_writes[PAGE_WORDS];    // Words the disk reads from a sector into memory
+} PageCounts;
+
+// Access counts of a run
+typedef struct MemoryProfile {
+    PageCounts** pages;                 // Counts of each page, NULL until a word of the page is used
+    int page_num;
+    CacheModel* cache;                  // NULL without -cache
+} MemoryProfile;
+
+// Reads "size,line,ways[,miss]" of -cache. Returns 0 on success
+int parse_cache_option(const char* text, ProfileOptions* options);
+// Makes the profile of a run on a memory of depth words, NULL if neither -heatmap nor -cache is given
+MemoryProfile* profile_create(const ProfileOptions* options, int depth);
+// Counts a lw or sw. Returns the extra cycles of a cache miss
+int profile_access(MemoryProfile* profile, int address, int is_write);
+// Counts the disk DMA of a command that is about to start. The DMA does not use the cache,
+// the lines of the words it writes are dropped from the cache
+void profile_disk(MemoryProfile* profile, const IORegisters* io_registers);
+// Writes the heatmap file and prints the cache results. filename is NULL without -heatmap
+void profile_write(const MemoryProfile* profile, const char* filename);
+// Frees the profile
+void profile_free(MemoryProfile* profile);
+#endif
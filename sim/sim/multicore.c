@@ -0,0 +1,225 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "multicore.h"
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include "stats.h"
+
+// MULTI-CORE FUNCTIONS
+
+
+// State shared by the threads of the cores
+typedef struct {
+    mtx_t lock;
+    cnd_t changed;          // Signaled when the turn or the quantum changes
+    int core_num;
+    int quantum;
+    int deterministic;
+    int arrived;            // Cores at the end of the current quantum
+    int halted_num;         // Halted cores among them
+    int generation;         // Number of the current quantum
+    int turn;               // Core that runs in deterministic mode
+    int done;               // All cores halted
+} Cluster;
+
+// A core with its own registers, pc, interrupt state and IO registers
+typedef struct {
+    Machine machine;
+    Registers registers;
+    IORegisters io_registers;
+    IRQ2Data irq2;          // Empty except for core 0, which uses the events of irq2in
+    SimStats stats;
+    Cluster* cluster;
+} Core;
+
+// Writes the name of an output file of a core, the core number goes before the extension
+void core_filename(char* buffer, size_t size, const char* filename, int core) {
+    if (core == 0) {
+        snprintf(buffer, size, "%s", filename);
+        return;
+    }
+    const char* dot = strrchr(filename, '.');
+    const char* slash = strrchr(filename, '/');
+    const char* backslash = strrchr(filename, '\\');
+    if (backslash && (!slash || backslash > slash)) {
+        slash = backslash;
+    }
+    if (!dot || (slash && dot < slash)) {
+        snprintf(buffer, size, "%s.core%d", filename, core);
+        return;
+    }
+    snprintf(buffer, size, "%.*s.core%d%s", (int)(dot - filename), filename, core, dot);
+}
+
+// Waits for all cores at the end of a quantum. Returns 1 when all cores halted
+static int end_quantum(Cluster* cluster, int halted) {
+    mtx_lock(&cluster->lock);
+    int generation = cluster->generation;
+    cluster->halted_num += halted;
+    if (++cluster->arrived == cluster->core_num) {
+        // The last core starts the next quantum
+        cluster->done = cluster->halted_num == cluster->core_num;
+        cluster->arrived = 0;
+        cluster->halted_num = 0;
+        cluster->turn = 0;
+        cluster->generation++;
+        cnd_broadcast(&cluster->changed);
+    }
+    else {
+        while (generation == cluster->generation) {
+            cnd_wait(&cluster->changed, &cluster->lock);
+        }
+    }
+    int done = cluster->done;
+    mtx_unlock(&cluster->lock);
+    return done;
+}
+
+// Thread of a core: runs the core quantum by quantum until all cores halted.
+// In deterministic mode the cores take turns, so the shared memory and devices see the same order in every run
+static int run_core(void* argument) {
+    Core* core = argument;
+    Cluster* cluster = core->cluster;
+    Machine* machine = &core->machine;
+    uint64_t quantum_end = 0;
+    int done = 0;
+
+    while (!done) {
+        quantum_end += (uint64_t)cluster->quantum;
+        if (cluster->deterministic) {
+            mtx_lock(&cluster->lock);
+            while (cluster->turn != machine->core) {
+                cnd_wait(&cluster->changed, &cluster->lock);
+            }
+            mtx_unlock(&cluster->lock);
+        }
+
+        while (machine->io_registers->halt && machine->cycles < quantum_end) {
+            machine_step(machine);
+        }
+
+        if (cluster->deterministic) {
+            mtx_lock(&cluster->lock);
+            cluster->turn++;
+            cnd_broadcast(&cluster->changed);
+            mtx_unlock(&cluster->lock);
+        }
+        done = end_quantum(cluster, !machine->io_registers->halt);
+    }
+    return 0;
+}
+
+// Runs the program on the cores and writes the output files of each core
+void run_cores(Memory* memory, Disk* disk, Monitor* monitor, IRQ2Data* irq2, const char* files[], const CoreOptions* options, const SymbolMap* map,
+    const char* stats_filename, const ProfileOptions* profile) {
+    Cluster cluster;
+    struct timespec start, end;
+    mtx_t device_lock;
+    char trace[512], hwregtrace[512], leds[512], display7seg[512];
+    int core_num = options->core_num;
+
+    memset(&cluster, 0, sizeof(Cluster));
+    cluster.core_num = core_num;
+    cluster.quantum = options->quantum > 0 ? options->quantum : DEFAULT_QUANTUM;
+    cluster.deterministic = options->deterministic;
+    Core* cores = calloc((size_t)core_num, sizeof(Core));
+    thrd_t* threads = malloc((size_t)core_num * sizeof(thrd_t));
+    if (!cores || !threads || mtx_init(&cluster.lock, mtx_plain) != thrd_success || cnd_init(&cluster.changed) != thrd_success ||
+        mtx_init(&device_lock, mtx_plain) != thrd_success) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+
+    // Each core has its registers and IO registers, the memory, disk and monitor are shared.
+    // The pages of the shared memory are allocated before the threads start
+    memory_share(memory);
+    for (int i = 0; i < core_num; i++) {
+        Core* core = &cores[i];
+        Machine* machine = &core->machine;
+        registers_init(&core->registers);
+        io_init(&core->io_registers);
+        core->io_registers.address_bits = memory->address_bits;
+        core->io_registers.IORegistersArray[COREID] = i;
+        if (i > 0) {
+            core->io_registers.devices = &cores[0].io_registers;
+        }
+        core->cluster = &cluster;
+        machine->registers = &core->registers;
+        machine->memory = memory;
+        machine->io_registers = &core->io_registers;
+        machine->irq2 = i == 0 ? irq2 : &core->irq2;
+        machine->monitor = monitor;
+        machine->disk = disk;
+        machine->map = map;
+        machine->core = i;
+        machine->device_lock = &device_lock;
+        machine->stats = stats_filename ? &core->stats : NULL;
+        machine->profile = profile_create(profile, memory->depth);
+
+        core_filename(trace, sizeof(trace), files[5], i);
+        core_filename(hwregtrace, sizeof(hwregtrace), files[6], i);
+        core_filename(leds, sizeof(leds), files[8], i);
+        core_filename(display7seg, sizeof(display7seg), files[9], i);
+        if (machine_open_files(machine, trace, hwregtrace, leds, display7seg) != 0) {
+            printf("Error: Could not open the output files of core %d.\n", i);
+            for (int j = 0; j < i; j++) {
+                machine_close_files(&cores[j].machine);
+            }
+            for (int j = 0; j <= i; j++) {
+                profile_free(cores[j].machine.profile);
+            }
+            free(cores);
+            free(threads);
+            return;
+        }
+    }
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < core_num; i++) {
+        if (thrd_create(&threads[i], run_core, &cores[i]) != thrd_success) {
+            printf("Error: Could not start the thread of core %d.\n", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < core_num; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    timespec_get(&end, TIME_UTC);
+
+    // Add the timer to the clock cycles of core 0, which owns the disk
+    cores[0].io_registers.IORegistersArray[CLKS] += disk->timer;
+
+    // Write the output files of the cores
+    for (int i = 0; i < core_num; i++) {
+        char regout[512], cycles[512];
+        core_filename(regout, sizeof(regout), files[4], i);
+        core_filename(cycles, sizeof(cycles), files[7], i);
+        machine_close_files(&cores[i].machine);
+        write_registers_to_file(regout, &cores[i].registers);
+        write_total_cycles(cycles, &cores[i].io_registers);
+        if (stats_filename) {
+            char stats[512];
+            core_filename(stats, sizeof(stats), stats_filename, i);
+            cores[i].stats.wall_seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+            write_stats_file(stats, &cores[i].stats, &cores[i].io_registers, cores[i].machine.irq2);
+        }
+        if (cores[i].machine.profile) {
+            char heatmap[512];
+            if (profile->heatmap_filename) {
+                core_filename(heatmap, sizeof(heatmap), profile->heatmap_filename, i);
+            }
+            if (profile->cache_words > 0) {
+                printf("Core %d: ", i);
+            }
+            profile_write(cores[i].machine.profile, profile->heatmap_filename ? heatmap : NULL);
+            profile_free(cores[i].machine.profile);
+        }
+    }
+
+    mtx_destroy(&device_lock);
+    cnd_destroy(&cluster.changed);
+    mtx_destroy(&cluster.lock);
+    free(threads);
+    free(cores);
+}
@@ -0,0 +1,27 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include "machine.h"
+#include "memprofile.h"
+
+// MULTI-CORE DEFINITIONS
+#define MAX_CORES 64
+#define DEFAULT_QUANTUM 256 // Cycles a core runs before it waits for the other cores
+
+// Options of a multi-core run
+typedef struct {
+    int core_num;           // -cores N: number of cores, 1 runs the single core simulator
+    int quantum;            // -quantum K: the cores are at most K cycles apart
+    int deterministic;      // -det: the cores run their quanta one after the other in core order
+} CoreOptions;
+
+// Writes the name of an output file of a core: core 0 uses the name, core 1 of "trace.txt" is "trace.core1.txt"
+void core_filename(char* buffer, size_t size, const char* filename, int core);
+// Runs the program on core_num cores with shared memory, disk and monitor, each core on its own thread.
+// The disk and monitor registers and the IRQ2 events belong to core 0. files has the 13 files of the
+// command line, the trace, hwregtrace, leds, display7seg, regout and cycles files are written per core.
+// stats_filename is NULL or the stats file of -stats. The stats and the heatmap are also written per core,
+// each core has its own cache model
+void run_cores(Memory* memory, Disk* disk, Monitor* monitor, IRQ2Data* irq2, const char* files[], const CoreOptions* options, const SymbolMap* map,
+    const char* stats_filename, const ProfileOptions* profile);
+#endif
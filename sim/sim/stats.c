@@ -0,0 +1,133 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "stats.h"
+
+// STATISTICS FUNCTIONS
+
+// Device events that stats_before_devices sees coming
+#define EVENT_TIMER         1   // The timer reaches timermax
+#define EVENT_DISK_DONE     2   // The disk command finishes
+#define EVENT_DISK_READ     4   // A read command starts
+#define EVENT_DISK_WRITE    8   // A write command starts
+#define EVENT_MAIN          16  // Not in an interrupt handler
+#define EVENT_PIXEL         32  // A pixel write is pending
+
+// Counts an instruction after the decode
+void stats_count_instruction(SimStats* stats, const Instruction* decoded, const Registers* snapshot) {
+    int opcode = (uint8_t)decoded->opcode;
+    stats->opcodes[opcode]++;
+    stats->bigimm += decoded->is_bigimm;
+
+    if (opcode >= OP_BEQ && opcode <= OP_BGE) {
+        int32_t a = snapshot->regs[decoded->rs];
+        int32_t b = snapshot->regs[decoded->rt];
+        int taken = 0;
+        switch (opcode) {
+        case OP_BEQ: taken = a == b; break;
+        case OP_BNE: taken = a != b; break;
+        case OP_BLT: taken = a < b; break;
+        case OP_BGT: taken = a > b; break;
+        case OP_BLE: taken = a <= b; break;
+        case OP_BGE: taken = a >= b; break;
+        }
+        stats->taken[opcode] += taken;
+        stats->not_taken[opcode] += !taken;
+    }
+}
+
+// Notes the state before the timer, the disk, the interrupts and the monitor are updated
+int stats_before_devices(const Machine* machine) {
+    const int32_t* io = machine->io_registers->IORegistersArray;
+    int events = 0;
+
+    if (io[TIMERENABLE] == 1 && io[TIMERCURRENT] + 1 == io[TIMERMAX]) {
+        events |= EVENT_TIMER;
+    }
+    if (io[DISKSTATUS] == 1) {
+        if (machine->disk->timer == 1) {
+            events |= EVENT_DISK_DONE;
+        }
+    }
+    else if (io[DISKCMD] == 1) {
+        events |= EVENT_DISK_READ;
+    }
+    else if (io[DISKCMD] == 2) {
+        events |= EVENT_DISK_WRITE;
+    }
+    if (!machine->in_interrupt) {
+        events |= EVENT_MAIN;
+    }
+    if (io[MONITORCMD] == 1) {
+        events |= EVENT_PIXEL;
+    }
+    return events;
+}
+
+// Counts what machine_finish did to the devices
+void stats_after_devices(SimStats* stats, const Machine* machine, int events) {
+    const int32_t* io = machine->io_registers->IORegistersArray;
+
+    stats->irq_raised[0] += (events & EVENT_TIMER) != 0;
+    stats->irq_raised[1] += (events & EVENT_DISK_DONE) != 0;
+    stats->disk_reads += (events & EVENT_DISK_READ) != 0;
+    stats->disk_writes += (events & EVENT_DISK_WRITE) != 0;
+    if ((events & EVENT_MAIN) && machine->in_interrupt) {
+        stats->irq_taken[0] += (io[IRQ0ENABLE] & io[IRQ0STATUS]) != 0;
+        stats->irq_taken[1] += (io[IRQ1ENABLE] & io[IRQ1STATUS]) != 0;
+        stats->irq_taken[2] += (io[IRQ2ENABLE] & io[IRQ2STATUS]) != 0;
+    }
+    if ((events & EVENT_PIXEL) && io[MONITORCMD] == 0) {
+        stats->pixels++;
+    }
+}
+
+// Writes the counters as JSON
+int write_stats_file(const char* filename, const SimStats* stats, const IORegisters* io_registers, const IRQ2Data* irq2) {
+    FILE* file = fopen(filename, "w");
+    uint64_t instructions = 0;
+    uint64_t unknown = 0;
+
+    if (!file) {
+        printf("Error: Could not open stats file '%s'.\n", filename);
+        return -1;
+    }
+    for (int i = 0; i < STATS_OPCODES; i++) {
+        instructions += stats->opcodes[i];
+        if (i > OP_HALT) {
+            unknown += stats->opcodes[i];
+        }
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"instructions\": %llu,\n", (unsigned long long)instructions);
+    fprintf(file, "  \"cycles\": %u,\n", (uint32_t)io_registers->IORegistersArray[CLKS]);
+    fprintf(file, "  \"opcodes\": {");
+    for (int i = 0; i <= OP_HALT; i++) {
+        fprintf(file, "%s\"%s\": %llu", i ? ", " : "", opcode_name(i), (unsigned long long)stats->opcodes[i]);
+    }
+    fprintf(file, ", \"unknown\": %llu},\n", (unsigned long long)unknown);
+    fprintf(file, "  \"bigimm\": %llu,\n", (unsigned long long)stats->bigimm);
+    fprintf(file, "  \"imm8\": %llu,\n", (unsigned long long)(instructions - stats->bigimm));
+    fprintf(file, "  \"bigimm_ratio\": %.6f,\n", instructions ? (double)stats->bigimm / (double)instructions : 0.0);
+    fprintf(file, "  \"branches\": {");
+    for (int i = OP_BEQ; i <= OP_BGE; i++) {
+        fprintf(file, "%s\"%s\": {\"taken\": %llu, \"not_taken\": %llu}", i > OP_BEQ ? ", " : "", opcode_name(i),
+            (unsigned long long)stats->taken[i], (unsigned long long)stats->not_taken[i]);
+    }
+    fprintf(file, "},\n");
+    fprintf(file, "  \"loads\": %llu,\n", (unsigned long long)stats->opcodes[OP_LW]);
+    fprintf(file, "  \"stores\": %llu,\n", (unsigned long long)stats->opcodes[OP_SW]);
+    fprintf(file, "  \"interrupt_cycles\": %llu,\n", (unsigned long long)stats->interrupt_cycles);
+    fprintf(file, "  \"main_cycles\": %llu,\n", (unsigned long long)stats->main_cycles);
+    fprintf(file, "  \"irq\": {\"irq0\": {\"raised\": %llu, \"taken\": %llu}, \"irq1\": {\"raised\": %llu, \"taken\": %llu}, \"irq2\": {\"raised\": %d, \"taken\": %llu}},\n",
+        (unsigned long long)stats->irq_raised[0], (unsigned long long)stats->irq_taken[0],
+        (unsigned long long)stats->irq_raised[1], (unsigned long long)stats->irq_taken[1],
+        irq2->index, (unsigned long long)stats->irq_taken[2]);
+    fprintf(file, "  \"disk\": {\"busy_cycles\": %llu, \"reads\": %llu, \"writes\": %llu},\n",
+        (unsigned long long)stats->disk_busy_cycles, (unsigned long long)stats->disk_reads, (unsigned long long)stats->disk_writes);
+    fprintf(file, "  \"pixels\": %llu,\n", (unsigned long long)stats->pixels);
+    fprintf(file, "  \"wall_seconds\": %.6f,\n", stats->wall_seconds);
+    fprintf(file, "  \"mips\": %.3f\n", stats->wall_seconds > 0 ? (double)instructions / stats->wall_seconds / 1e6 : 0.0);
+    fprintf(file, "}\n");
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "fe_de_ex.h"
+#include "machine.h"
+
+// STATISTICS DEFINITIONS
+#define STATS_OPCODES 256   // Counters for every opcode byte, unknown opcodes included
+
+// Counters of a run for -stats. Each counter is a single add in the step, the JSON is made at exit
+typedef struct SimStats {
+    uint64_t opcodes[STATS_OPCODES];    // Executed instructions per opcode
+    uint64_t bigimm;                    // Executed bigimm instructions, the rest use imm8
+    uint64_t taken[OP_BGE + 1];         // Taken and not taken branches per branch opcode
+    uint64_t not_taken[OP_BGE + 1];
+    uint64_t interrupt_cycles;          // Cycles of instructions that started in an interrupt handler
+    uint64_t main_cycles;               // Cycles of the other instructions
+    uint64_t irq_raised[2];             // Timer expirations and finished disk commands, IRQ2 counts the events of irq2in that arrived
+    uint64_t irq_taken[3];              // Jumps to the handler, an interrupt counts for each pending irq
+    uint64_t disk_busy_cycles;          // Cycles of instructions that started while the disk was busy
+    uint64_t disk_reads;
+    uint64_t disk_writes;
+    uint64_t pixels;                    // Pixels written to the monitor
+    double wall_seconds;                // Host time of the run
+} SimStats;
+
+// Counts an instruction after the decode, snapshot has the registers with $imm
+void stats_count_instruction(SimStats* stats, const Instruction* decoded, const Registers* snapshot);
+// Notes the timer, disk, interrupt and monitor state before machine_finish updates the devices
+int stats_before_devices(const Machine* machine);
+// Counts the device events of machine_finish, events is the result of stats_before_devices
+void stats_after_devices(SimStats* stats, const Machine* machine, int events);
+// Writes the counters as JSON with the final clock cycles and the IRQ2 events that arrived. Returns 0 on success
+int write_stats_file(const char* filename, const SimStats* stats, const IORegisters* io_registers, const IRQ2Data* irq2);
+#endif
@@ -0,0 +1,152 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "symbols.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// SYMBOL MAP FUNCTIONS
+
+
+// Grows the line table to hold the address, the new words have no line. Returns 0 on success
+static int grow_line_table(SymbolMap* map, int address) {
+    int line_num = map->line_num > 0 ? map->line_num : DATA_MEM_DEPTH;
+    while (line_num <= address) {
+        line_num *= 2;
+    }
+    int* line_file = realloc(map->line_file, (size_t)line_num * sizeof(int));
+    if (!line_file) {
+        return -1;
+    }
+    map->line_file = line_file;
+    int* line = realloc(map->line, (size_t)line_num * sizeof(int));
+    if (!line) {
+        return -1;
+    }
+    map->line = line;
+    for (int i = map->line_num; i < line_num; i++) {
+        map->line_file[i] = -1;
+        map->line[i] = 0;
+    }
+    map->line_num = line_num;
+    return 0;
+}
+
+// Loads a symbol map file. The file is kept in memory and the names point into it
+int load_symbol_map(const char* filename, SymbolMap* map) {
+    memset(map, 0, sizeof(SymbolMap));
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    map->names = malloc(size > 0 ? (size_t)size + 1 : 1);
+    if (!map->names) {
+        fclose(file);
+        return -1;
+    }
+    size_t read = fread(map->names, 1, size > 0 ? (size_t)size : 0, file);
+    map->names[read] = '\0';
+    fclose(file);
+
+    // Header: magic, version and the number of files, labels and lines
+    char magic[16];
+    int version, file_num, symbol_num, line_num;
+    if (sscanf(map->names, "%15s %d %d %d %d", magic, &version, &file_num, &symbol_num, &line_num) != 5 ||
+        strcmp(magic, MAP_MAGIC) != 0 || version != MAP_VERSION || file_num < 0 || symbol_num < 0) {
+        free_symbol_map(map);
+        return -1;
+    }
+    map->files = calloc((size_t)file_num + 1, sizeof(char*));
+    map->symbols = malloc(((size_t)symbol_num + 1) * sizeof(MapSymbol));
+    if (!map->files || !map->symbols) {
+        free_symbol_map(map);
+        return -1;
+    }
+
+    // Go over the records, each line is terminated in place
+    char* line = map->names;
+    while (*line) {
+        char* end = line + strcspn(line, "\r\n");
+        char* next = end + strspn(end, "\r\n");
+        *end = '\0';
+
+        int address, index, number, length = 0;
+        if (line[0] == 'F' && map->file_num < file_num && sscanf(line, "F %d %n", &index, &length) == 1 && length > 0) {
+            map->files[map->file_num++] = line + length;
+        }
+        else if (line[0] == 'S' && map->symbol_num < symbol_num && sscanf(line, "S %x %n", &address, &length) == 1 && length > 0) {
+            map->symbols[map->symbol_num].address = address;
+            map->symbols[map->symbol_num].name = line + length;
+            map->symbol_num++;
+        }
+        else if (line[0] == 'L' && sscanf(line, "L %x %d %d", &address, &index, &number) == 3 &&
+            address >= 0 && address < (1 << MAX_ADDRESS_BITS) && index >= 0 && index < file_num) {
+            if (address >= map->line_num && grow_line_table(map, address) != 0) {
+                free_symbol_map(map);
+                return -1;
+            }
+            map->line_file[address] = index;
+            map->line[address] = number;
+        }
+        line = next;
+    }
+    return 0;
+}
+
+// Frees the memory of a symbol map
+void free_symbol_map(SymbolMap* map) {
+    free(map->symbols);
+    free(map->files);
+    free(map->names);
+    free(map->line_file);
+    free(map->line);
+    map->symbols = NULL;
+    map->line_file = NULL;
+    map->line = NULL;
+    map->line_num = 0;
+    map->files = NULL;
+    map->names = NULL;
+    map->symbol_num = 0;
+    map->file_num = 0;
+}
+
+// Finds the last label at or before the address with a binary search
+const MapSymbol* find_symbol(const SymbolMap* map, int address) {
+    int low = 0;
+    int high = map->symbol_num;
+
+    // First label after the address
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (map->symbols[middle].address <= address) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low > 0 ? &map->symbols[low - 1] : NULL;
+}
+
+// Writes "label+offset file:line" for the address, the parts that are unknown are left out
+void format_location(const SymbolMap* map, int address, char* buffer, size_t size) {
+    const MapSymbol* symbol = find_symbol(map, address);
+    int length = 0;
+
+    buffer[0] = '\0';
+    if (symbol && symbol->address == address) {
+        length = snprintf(buffer, size, "%s", symbol->name);
+    }
+    else if (symbol) {
+        length = snprintf(buffer, size, "%s+%d", symbol->name, address - symbol->address);
+    }
+    if (length < 0 || (size_t)length >= size) {
+        return;
+    }
+    if (address >= 0 && address < map->line_num && map->line_file[address] >= 0 && map->line_file[address] < map->file_num) {
+        snprintf(buffer + length, size - (size_t)length, "%s%s:%d", length ? " " : "", map->files[map->line_file[address]], map->line[address]);
+    }
+}
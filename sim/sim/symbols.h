@@ -0,0 +1,38 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+#include "data.h"
+
+// SYMBOL MAP DEFINITIONS
+#define MAP_MAGIC "SIMPMAP" // First word of a symbol map file
+#define MAP_VERSION 1
+
+// Label of the program
+typedef struct {
+    int address;
+    const char* name;
+} MapSymbol;
+
+// Symbol map written by the assembler (asm -g). Labels are sorted by address for a binary search,
+// the source line of each memory word is a direct table up to the last word that has a line
+typedef struct {
+    MapSymbol* symbols;             // Labels sorted by address
+    int symbol_num;
+    char** files;                   // Source files
+    int file_num;
+    int* line_file;                 // Source file of each word, -1 if unknown
+    int* line;                      // Source line of each word
+    int line_num;                   // Words in the line table
+    char* names;                    // Buffer that holds the label names
+} SymbolMap;
+
+// Loads a symbol map file, returns 0 on success
+int load_symbol_map(const char* filename, SymbolMap* map);
+// Frees the memory of a symbol map
+void free_symbol_map(SymbolMap* map);
+// Finds the last label at or before the address, NULL if there is none
+const MapSymbol* find_symbol(const SymbolMap* map, int address);
+// Writes "label+offset file:line" for the address
+void format_location(const SymbolMap* map, int address, char* buffer, size_t size);
+#endif
@@ -0,0 +1,381 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../sim/fe_de_ex.h"
+#include "../../asm/asm/simp_asm.h"
+
+// simp2c translates a memin image to C. Every word of the image gets a label, branches to constant
+// addresses are gotos and the other jumps go through a switch on the pc. The devices, the trace and the
+// interrupts are the simulator's own functions, called at the same cycle points as in the interpreter.
+// The C file is compiled with the simulator sources and SIMP_TRANSLATED into a simulator for this program
+
+// Fields of an instruction word
+typedef struct {
+    int opcode;
+    int rd;
+    int rs;
+    int rt;
+    int bigimm;
+    int32_t immediate;  // Sign extended imm8, or the next word for bigimm
+    int size;           // Words of the instruction
+} Decoded;
+
+// Function declarations
+void decode_word(const int* words, int word_num, int address, Decoded* decoded);
+int is_branch(int opcode);
+void find_code(const int* words, int word_num, uint8_t code[]);
+const char* operand(char* buffer, size_t size, int reg, int32_t immediate);
+void write_instruction(FILE* file, const int* words, int word_num, const uint8_t code[], int address);
+int write_translation(const char* filename, const char* input, const int* words, int word_num, const uint8_t code[]);
+
+int main(int argc, char* argv[])
+{
+    // One more word than the memory to find images that do not fit
+    static int words[DATA_MEM_DEPTH + 1];
+    static uint8_t code[DATA_MEM_DEPTH];
+
+    if (argc != 3) {
+        printf("Usage: %s <memin_file> <output.c>\n", argv[0]);
+        printf("Build the simulator of the program with the simulator sources:\n");
+        printf("  cc -O2 -DSIMP_TRANSLATED -Isim/sim output.c sim/sim/*.c asm/asm/assembler.c\n");
+        return 1;
+    }
+
+    int word_num = read_image_file(argv[1], words, DATA_MEM_DEPTH + 1);
+    if (word_num < 0) {
+        printf("Error: Could not read memin file '%s'.\n", argv[1]);
+        return 1;
+    }
+    if (word_num > DATA_MEM_DEPTH) {
+        printf("Error: The image '%s' is larger than the %d words simp2c translates.\n", argv[1], DATA_MEM_DEPTH);
+        return 1;
+    }
+    find_code(words, word_num, code);
+    return write_translation(argv[2], argv[1], words, word_num, code) == 0 ? 0 : 1;
+}
+
+// Splits a word into its fields, like instruction_decode
+void decode_word(const int* words, int word_num, int address, Decoded* decoded) {
+    uint32_t word = (uint32_t)words[address];
+    decoded->opcode = (int)((word >> 24) & 0xFF);
+    decoded->rd = (int)((word >> 20) & 0x0F);
+    decoded->rs = (int)((word >> 16) & 0x0F);
+    decoded->rt = (int)((word >> 12) & 0x0F);
+    decoded->bigimm = (int)((word >> 8) & 0x01);
+    if (decoded->bigimm) {
+        decoded->immediate = address + 1 < word_num ? (int32_t)words[address + 1] : 0;
+        decoded->size = 2;
+    }
+    else {
+        decoded->immediate = (int8_t)(word & 0xFF);
+        decoded->size = 1;
+    }
+}
+
+// 1 for beq to bge
+int is_branch(int opcode) {
+    return opcode >= OP_BEQ && opcode <= OP_BGE;
+}
+
+// Marks the words that the program reaches from pc 0 with the constant branches and jumps, and the
+// return addresses of jal. A store into one of them stops the translated code. The other words are
+// only reached through a register or an interrupt, they are checked before they run
+void find_code(const int* words, int word_num, uint8_t code[]) {
+    static int stack[DATA_MEM_DEPTH];
+    int stack_num = 0;
+
+    memset(code, 0, DATA_MEM_DEPTH);
+    if (word_num > 0) {
+        stack[stack_num++] = 0;
+    }
+    while (stack_num > 0) {
+        int address = stack[--stack_num];
+        if (address < 0 || address >= word_num || code[address]) {
+            continue;
+        }
+        Decoded decoded;
+        decode_word(words, word_num, address, &decoded);
+        code[address] = 1;
+        if (decoded.bigimm && address + 1 < word_num) {
+            code[address + 1] = 1;
+        }
+
+        int next = address + decoded.size;
+        int fall_through = 1;
+        int target = -1;
+        if (is_branch(decoded.opcode)) {
+            // A compare of a register with itself is always or never taken
+            int always = decoded.opcode == OP_BEQ || decoded.opcode == OP_BLE || decoded.opcode == OP_BGE;
+            if (decoded.rs == decoded.rt) {
+                fall_through = !always;
+            }
+            if (decoded.rs != decoded.rt || always) {
+                target = decoded.rd == REG_IMM ? decoded.immediate : decoded.rd == REG_ZERO ? 0 : -1;
+            }
+        }
+        else if (decoded.opcode == OP_JAL) {
+            target = decoded.rs == REG_IMM ? decoded.immediate : decoded.rs == REG_ZERO ? 0 : -1;
+        }
+        else if (decoded.opcode == OP_RETI || decoded.opcode == OP_HALT || decoded.opcode >= NUM_OPCODES) {
+            fall_through = 0;
+        }
+
+        if (fall_through && stack_num < DATA_MEM_DEPTH) {
+            stack[stack_num++] = next;
+        }
+        if (target >= 0 && stack_num < DATA_MEM_DEPTH) {
+            stack[stack_num++] = target;
+        }
+    }
+}
+
+// C expression of a register operand, $zero and $imm are constants
+const char* operand(char* buffer, size_t size, int reg, int32_t immediate) {
+    if (reg == REG_ZERO) {
+        snprintf(buffer, size, "0");
+    }
+    else if (reg == REG_IMM && immediate >= -32768 && immediate <= 32767) {
+        snprintf(buffer, size, "%d", immediate);
+    }
+    else if (reg == REG_IMM) {
+        snprintf(buffer, size, "(int32_t)0x%08XU", (uint32_t)immediate);
+    }
+    else {
+        snprintf(buffer, size, "R[%d]", reg);
+    }
+    return buffer;
+}
+
+// Writes the C code of the instruction at the address
+void write_instruction(FILE* file, const int* words, int word_num, const uint8_t code[], int address) {
+    static const char* alu_macros[] = { "ADD", "SUB", "MUL", "AND", "OR", "XOR", "SLL", "SRA", "SRL" };
+    static const char* compares[] = { "==", "!=", "<", ">", "<=", ">=" };
+    char rd[32], rs[32], rt[32], immediate[32];
+    Decoded decoded;
+
+    decode_word(words, word_num, address, &decoded);
+    operand(rd, sizeof(rd), decoded.rd, decoded.immediate);
+    operand(rs, sizeof(rs), decoded.rs, decoded.immediate);
+    operand(rt, sizeof(rt), decoded.rt, decoded.immediate);
+    int writes_rd = decoded.rd != REG_ZERO && decoded.rd != REG_IMM;
+    int next = address + decoded.size;
+    int target = -1;    // Constant address of a branch or jump
+
+    if (decoded.opcode < NUM_OPCODES) {
+        fprintf(file, "pc_%03X: // %s %s, %s, %s, %d\n", address, opcode_name(decoded.opcode),
+            register_name(decoded.rd), register_name(decoded.rs), register_name(decoded.rt), decoded.immediate);
+    }
+    else {
+        fprintf(file, "pc_%03X: // .word 0x%08X\n", address, (uint32_t)words[address]);
+    }
+    // A word that was not found as code may have been changed by the program, with the immediate of bigimm
+    if (!code[address] && decoded.bigimm) {
+        fprintf(file, "    if (modified[0x%03X] || modified[0x%03X]) return;\n", address, address + 1);
+    }
+    else if (!code[address]) {
+        fprintf(file, "    if (modified[0x%03X]) return;\n", address);
+    }
+    fprintf(file, "    R[REG_IMM] = %s;\n", operand(immediate, sizeof(immediate), REG_IMM, decoded.immediate));
+    fprintf(file, "    snapshot = *machine->registers;\n");
+    if (decoded.bigimm) {
+        fprintf(file, "    machine_cycle(machine);\n");
+    }
+
+    switch (decoded.opcode) {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_XOR: case OP_SLL: case OP_SRA: case OP_SRL:
+        if (writes_rd) {
+            fprintf(file, "    R[%d] = %s(%s, %s);\n", decoded.rd, alu_macros[decoded.opcode], rs, rt);
+        }
+        fprintf(file, "    machine->pc = 0x%03X;\n", next);
+        break;
+
+    case OP_BEQ: case OP_BNE: case OP_BLT: case OP_BGT: case OP_BLE: case OP_BGE:
+        fprintf(file, "    machine->pc = (%s %s %s) ? %s : 0x%03X;\n", rs, compares[decoded.opcode - OP_BEQ], rt, rd, next);
+        if (decoded.rd == REG_IMM || decoded.rd == REG_ZERO) {
+            target = decoded.rd == REG_IMM ? decoded.immediate : 0;
+        }
+        break;
+
+    case OP_JAL:
+        // The target is read before the return address is written, rd may be rs
+        fprintf(file, "    machine->pc = %s;\n", rs);
+        if (writes_rd) {
+            fprintf(file, "    R[%d] = 0x%03X;\n", decoded.rd, next);
+        }
+        if (decoded.rs == REG_IMM || decoded.rs == REG_ZERO) {
+            target = decoded.rs == REG_IMM ? decoded.immediate : 0;
+        }
+        break;
+
+    case OP_LW:
+        if (writes_rd) {
+            fprintf(file, "    address = ADD(%s, %s);\n", rs, rt);
+            fprintf(file, "    if (address >= 0 && address < machine->memory->depth) { R[%d] = memory_load(machine->memory, address); }\n", decoded.rd);
+        }
+        fprintf(file, "    machine->pc = 0x%03X;\n", next);
+        break;
+
+    case OP_SW:
+        fprintf(file, "    address = ADD(%s, %s);\n", rs, rt);
+        fprintf(file, "    if (address >= 0 && address < machine->memory->depth) {\n");
+        fprintf(file, "        write_data_to_memory(machine->memory, address, %s);\n", rd);
+        fprintf(file, "        stop = write_into_image(machine->memory, address);\n");
+        fprintf(file, "    }\n");
+        fprintf(file, "    machine->pc = 0x%03X;\n", next);
+        break;
+
+    case OP_RETI:
+        fprintf(file, "    machine->pc = machine->io_registers->IORegistersArray[IRQRETURN] & (machine->memory->depth - 1);\n");
+        fprintf(file, "    machine->in_interrupt = 0;\n");
+        break;
+
+    case OP_IN:
+        if (writes_rd) {
+            fprintf(file, "    address = ADD(%s, %s);\n", rs, rt);
+            fprintf(file, "    if (address >= 0 && address < NUM_IO_REGISTERS) { R[%d] = read_from_io(machine->io_registers, address, machine->hwregtrace_file); }\n", decoded.rd);
+        }
+        fprintf(file, "    machine->pc = 0x%03X;\n", next);
+        break;
+
+    case OP_OUT:
+        fprintf(file, "    address = ADD(%s, %s);\n", rs, rt);
+        fprintf(file, "    if (address >= 0 && address < NUM_IO_REGISTERS) { write_to_io(machine->io_registers, address, %s, machine->hwregtrace_file); }\n", rd);
+        fprintf(file, "    machine->pc = 0x%03X;\n", next);
+        break;
+
+    case OP_HALT:
+        fprintf(file, "    machine->pc = 0x%03X;\n", address);
+        fprintf(file, "    machine->io_registers->halt = 0;\n");
+        break;
+
+    default:
+        // The interpreter does not change the pc for an unknown opcode
+        fprintf(file, "    machine->pc = 0x%03X;\n", address);
+        next = address;
+        break;
+    }
+
+    fprintf(file, "    machine_finish(machine, 0x%03X, (int32_t)0x%08XU, &snapshot);\n", address, (uint32_t)words[address]);
+    if (decoded.opcode == OP_SW) {
+        fprintf(file, "    if (stop) return;\n");
+    }
+    else if (decoded.opcode == OP_OUT) {
+        fprintf(file, "    if (read_into_image(machine)) return;\n");
+    }
+
+    // Continue at the next instruction or the constant target without the switch
+    if (decoded.opcode == OP_HALT || decoded.opcode == OP_RETI) {
+        fprintf(file, "    goto dispatch;\n");
+    }
+    else if (is_branch(decoded.opcode) || decoded.opcode == OP_JAL) {
+        if (target >= 0 && target < word_num) {
+            fprintf(file, "    if (machine->pc == 0x%03X && machine->io_registers->halt) goto pc_%03X;\n", target, target);
+        }
+        if (decoded.opcode != OP_JAL && next < word_num) {
+            fprintf(file, "    if (machine->pc == 0x%03X && machine->io_registers->halt) goto pc_%03X;\n", next, next);
+        }
+        fprintf(file, "    goto dispatch;\n");
+    }
+    else if (next < word_num) {
+        fprintf(file, "    if (machine->pc != 0x%03X || !machine->io_registers->halt) goto dispatch;\n", next);
+        if (next != address + 1) {
+            fprintf(file, "    goto pc_%03X;\n", next);
+        }
+    }
+    else {
+        fprintf(file, "    goto dispatch;\n");
+    }
+}
+
+// Writes the C file of the program
+int write_translation(const char* filename, const char* input, const int* words, int word_num, const uint8_t code[]) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error: Could not open output file.\n");
+        return -1;
+    }
+
+    fprintf(file, "// Translated from %s by simp2c, do not edit\n", input);
+    fprintf(file, "// Build: cc -O2 -DSIMP_TRANSLATED -Isim/sim %s sim/sim/*.c asm/asm/assembler.c\n", filename);
+    fprintf(file, "#include <stdio.h>\n#include <stdint.h>\n#include \"machine.h\"\n\n");
+    fprintf(file, "// Arithmetic wraps around and shift counts use 5 bits, like the interpreter on the host\n");
+    fprintf(file, "#define ADD(a, b) ((int32_t)((uint32_t)(a) + (uint32_t)(b)))\n");
+    fprintf(file, "#define SUB(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))\n");
+    fprintf(file, "#define MUL(a, b) ((int32_t)((uint32_t)(a) * (uint32_t)(b)))\n");
+    fprintf(file, "#define AND(a, b) ((int32_t)(a) & (int32_t)(b))\n");
+    fprintf(file, "#define OR(a, b) ((int32_t)(a) | (int32_t)(b))\n");
+    fprintf(file, "#define XOR(a, b) ((int32_t)(a) ^ (int32_t)(b))\n");
+    fprintf(file, "#define SLL(a, b) ((int32_t)((uint32_t)(a) << ((b) & 31)))\n");
+    fprintf(file, "#define SRA(a, b) ((int32_t)(a) >> ((b) & 31))\n");
+    fprintf(file, "#define SRL(a, b) ((int32_t)((uint32_t)(a) >> ((b) & 31)))\n\n");
+    fprintf(file, "#define IMAGE_SIZE %d\n\n", word_num);
+
+    // The image and the words that were found as code
+    fprintf(file, "// Words the program was translated from\nstatic const int32_t image[IMAGE_SIZE + 1] = {");
+    for (int i = 0; i < word_num; i++) {
+        fprintf(file, "%s(int32_t)0x%08XU,", i % 6 == 0 ? "\n    " : " ", (uint32_t)words[i]);
+    }
+    fprintf(file, "\n    0\n};\n\n");
+    fprintf(file, "// 1 for the words reached from pc 0 without a jump through a register\nstatic const uint8_t code[IMAGE_SIZE + 1] = {");
+    for (int i = 0; i < word_num; i++) {
+        fprintf(file, "%s%d,", i % 32 == 0 ? "\n    " : " ", code[i]);
+    }
+    fprintf(file, "\n    0\n};\n\n");
+    fprintf(file, "// 1 for the words of the image that differ in memory, and the word after it that a bigimm at the end reads\n");
+    fprintf(file, "static uint8_t modified[IMAGE_SIZE + 1];\n\n");
+
+    // The helpers for sw and out, only when the program has them
+    int has_store = 0;
+    int has_out = 0;
+    for (int i = 0; i < word_num; i++) {
+        int opcode = (int)(((uint32_t)words[i] >> 24) & 0xFF);
+        has_store |= opcode == OP_SW || opcode == OP_OUT;
+        has_out |= opcode == OP_OUT;
+    }
+    if (has_store) {
+        fprintf(file, "// Marks a changed word of the image, returns 1 if the word is code and the interpreter has to take over\n");
+        fprintf(file, "static int write_into_image(const Memory* memory, int address) {\n");
+        fprintf(file, "    if (address > IMAGE_SIZE) {\n        return 0;\n    }\n");
+        fprintf(file, "    modified[address] = read_data_from_memory(memory, address) != image[address];\n");
+        fprintf(file, "    return modified[address] && code[address];\n}\n\n");
+    }
+    if (has_out) {
+        fprintf(file, "// A disk read that started in this instruction writes the sector to the buffer, returns 1 if it wrote code\n");
+        fprintf(file, "static int read_into_image(const Machine* machine) {\n");
+        fprintf(file, "    const int32_t* io = machine->io_registers->IORegistersArray;\n");
+        fprintf(file, "    int stop = 0;\n");
+        fprintf(file, "    if (io[DISKSTATUS] != 1 || io[DISKCMD] != 1 || machine->disk->timer != 1024) {\n        return 0;\n    }\n");
+        fprintf(file, "    for (int i = 0; i < LINES_PER_SECTOR; i++) {\n");
+        fprintf(file, "        int address = io[DISKBUFFER] + i;\n");
+        fprintf(file, "        if (address >= 0 && address < machine->memory->depth) {\n            stop |= write_into_image(machine->memory, address);\n        }\n");
+        fprintf(file, "    }\n    return stop;\n}\n\n");
+    }
+
+    // The program
+    fprintf(file, "// Runs the program until it halts, leaves the pc for the interpreter when it has to take over\n");
+    fprintf(file, "void translated_run(Machine* machine) {\n");
+    fprintf(file, "    int32_t* R = machine->registers->regs;\n");
+    fprintf(file, "    Registers snapshot;\n    int32_t address;\n    int stop = 0;\n\n");
+    fprintf(file, "    // memin may have other data than the image, but not other code\n");
+    fprintf(file, "    for (int i = 0; i <= IMAGE_SIZE && i < machine->memory->depth; i++) {\n");
+    fprintf(file, "        modified[i] = read_data_from_memory(machine->memory, i) != image[i];\n");
+    fprintf(file, "        if (modified[i] && code[i]) {\n");
+    fprintf(file, "            printf(\"Warning: The code at address %%03X is not the translated code, running in the interpreter\\n\", i);\n");
+    fprintf(file, "            return;\n        }\n    }\n");
+    fprintf(file, "    (void)address;\n    (void)stop;\n    goto dispatch;\n\n");
+    for (int address = 0; address < word_num; address++) {
+        write_instruction(file, words, word_num, code, address);
+    }
+
+    fprintf(file, "\ndispatch:\n");
+    fprintf(file, "    if (!machine->io_registers->halt) {\n        return;\n    }\n");
+    fprintf(file, "    switch (machine->pc) {\n");
+    for (int address = 0; address < word_num; address++) {
+        fprintf(file, "    case 0x%03X: goto pc_%03X;\n", address, address);
+    }
+    fprintf(file, "    default: return;\n    }\n}\n");
+    fclose(file);
+    return 0;
+}
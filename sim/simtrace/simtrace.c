@@ -0,0 +1,416 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <threads.h>
+#include "../sim/fe_de_ex.h"
+
+// simtrace diff compares two trace.txt files and shows where they first differ. The files are split
+// into fixed-size chunks that worker threads compare at the same offsets, each worker streams its own
+// chunks and the workers stop at the first chunk that differs. The lines from the chunk before it are
+// then read one record at a time in both files, until the first record whose cycle, pc, instruction
+// or registers differ. The label and source line that -map adds to a line are not compared
+
+#define DEFAULT_CHUNK_KB 1024
+#define DEFAULT_CONTEXT 3
+#define MAX_CONTEXT 64
+#define MAX_THREADS 64
+#define MAX_LINE 512
+
+#ifdef _WIN32
+#define seek_file _fseeki64
+#else
+#define seek_file fseeko
+#endif
+
+// A line of the trace
+typedef struct {
+    char text[MAX_LINE];        // The line without the line break
+    int parsed;                 // 1 if the fields below were read from the line
+    uint32_t cycle;
+    uint32_t pc;
+    uint32_t instruction;
+    uint32_t regs[NUM_REGISTERS];
+} TraceRecord;
+
+// Chunks the workers compare, guarded by lock
+typedef struct {
+    const char* filenames[2];
+    long long chunk_bytes;
+    long long chunk_num;
+    long long next_chunk;
+    long long first_diff;       // First chunk that differs, chunk_num if none
+    long long* newlines;        // Line breaks of every chunk that is the same in both files
+    int error;
+    mtx_t lock;
+} ChunkDiff;
+
+// Function declarations
+long long file_size(const char* filename);
+int chunk_worker(void* argument);
+long long find_first_chunk(ChunkDiff* diff, int thread_num);
+int read_record(FILE* file, TraceRecord* record);
+int same_record(const TraceRecord* a, const TraceRecord* b);
+void format_instruction(uint32_t instruction, char* buffer, size_t size);
+void print_difference(const TraceRecord* a, const TraceRecord* b, long long line);
+int compare_records(ChunkDiff* diff, long long first_chunk, int context);
+int run_diff(int argc, char* argv[]);
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "diff") == 0) {
+        return run_diff(argc, argv);
+    }
+    printf("Usage: %s diff [-j threads] [-chunk KB] [-context N] <trace_a> <trace_b>\n", argv[0]);
+    printf("Prints the first record where two trace.txt files differ. Returns 0 if they are the same, 1 if they differ, 2 on errors\n");
+    return 2;
+}
+
+// Size of a file in bytes, -1 if it can not be opened
+long long file_size(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return -1;
+    }
+    long long size = -1;
+    if (seek_file(file, 0, SEEK_END) == 0) {
+#ifdef _WIN32
+        size = _ftelli64(file);
+#else
+        size = (long long)ftello(file);
+#endif
+    }
+    fclose(file);
+    return size;
+}
+
+// Worker thread: compares the next chunk of both files until a chunk differs or all chunks are done.
+// The chunks before the first difference are all compared, the ones after it are skipped
+int chunk_worker(void* argument) {
+    ChunkDiff* diff = argument;
+    FILE* files[2] = { fopen(diff->filenames[0], "rb"), fopen(diff->filenames[1], "rb") };
+    char* buffers[2] = { malloc((size_t)diff->chunk_bytes), malloc((size_t)diff->chunk_bytes) };
+
+    if (!buffers[0] || !buffers[1]) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+    for (;;) {
+        mtx_lock(&diff->lock);
+        long long chunk = diff->next_chunk++;
+        int done = chunk >= diff->chunk_num || chunk > diff->first_diff || diff->error || !files[0] || !files[1];
+        if (!files[0] || !files[1]) {
+            diff->error = 1;
+        }
+        mtx_unlock(&diff->lock);
+        if (done) {
+            break;
+        }
+
+        size_t lengths[2];
+        for (int f = 0; f < 2; f++) {
+            lengths[f] = 0;
+            if (seek_file(files[f], chunk * diff->chunk_bytes, SEEK_SET) == 0) {
+                lengths[f] = fread(buffers[f], 1, (size_t)diff->chunk_bytes, files[f]);
+            }
+        }
+        if (lengths[0] != lengths[1] || memcmp(buffers[0], buffers[1], lengths[0]) != 0) {
+            mtx_lock(&diff->lock);
+            if (chunk < diff->first_diff) {
+                diff->first_diff = chunk;
+            }
+            mtx_unlock(&diff->lock);
+            continue;
+        }
+        // The line breaks give the line numbers of the report
+        long long newlines = 0;
+        for (const char* p = buffers[0]; (p = memchr(p, '\n', lengths[0] - (size_t)(p - buffers[0]))) != NULL; p++) {
+            newlines++;
+        }
+        diff->newlines[chunk] = newlines;
+    }
+
+    for (int f = 0; f < 2; f++) {
+        if (files[f]) {
+            fclose(files[f]);
+        }
+        free(buffers[f]);
+    }
+    return 0;
+}
+
+// Compares the chunks of both files on the threads. Returns the first chunk that differs,
+// chunk_num if the files are the same, or -1 if a file could not be read
+long long find_first_chunk(ChunkDiff* diff, int thread_num) {
+    thrd_t threads[MAX_THREADS];
+    int started = 0;
+
+    for (; started < thread_num; started++) {
+        if (thrd_create(&threads[started], chunk_worker, diff) != thrd_success) {
+            break;
+        }
+    }
+    // Work on the calling thread too if no thread could be started
+    if (started == 0) {
+        chunk_worker(diff);
+    }
+    for (int i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    return diff->error ? -1 : diff->first_diff;
+}
+
+// Reads the next line of a trace and its fields. Returns 0 at the end of the file
+int read_record(FILE* file, TraceRecord* record) {
+    if (!fgets(record->text, sizeof(record->text), file)) {
+        return 0;
+    }
+    // A line longer than the buffer is cut, the rest of it is skipped
+    if (!strchr(record->text, '\n')) {
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '\n') {}
+    }
+    record->text[strcspn(record->text, "\r\n")] = '\0';
+
+    const char* p = record->text;
+    char* end;
+    uint32_t fields[3 + NUM_REGISTERS];
+    record->parsed = 1;
+    for (int i = 0; i < 3 + NUM_REGISTERS; i++) {
+        fields[i] = (uint32_t)strtoul(p, &end, 16);
+        if (end == p) {
+            record->parsed = 0;
+            break;
+        }
+        p = end;
+    }
+    if (record->parsed) {
+        record->cycle = fields[0];
+        record->pc = fields[1];
+        record->instruction = fields[2];
+        memcpy(record->regs, fields + 3, sizeof(record->regs));
+    }
+    return 1;
+}
+
+// 1 if two records have the same cycle, pc, instruction and registers. Lines that are not records are compared as text
+int same_record(const TraceRecord* a, const TraceRecord* b) {
+    if (!a->parsed || !b->parsed) {
+        return a->parsed == b->parsed && strcmp(a->text, b->text) == 0;
+    }
+    return a->cycle == b->cycle && a->pc == b->pc && a->instruction == b->instruction &&
+        memcmp(a->regs, b->regs, sizeof(a->regs)) == 0;
+}
+
+// Writes an instruction word as assembly, the immediate of bigimm is the next word and not in the trace
+void format_instruction(uint32_t instruction, char* buffer, size_t size) {
+    int opcode = (int)((instruction >> 24) & 0xFF);
+    if (opcode >= NUM_OPCODES) {
+        snprintf(buffer, size, "unknown opcode %d", opcode);
+        return;
+    }
+    int rd = (int)((instruction >> 20) & 0x0F);
+    int rs = (int)((instruction >> 16) & 0x0F);
+    int rt = (int)((instruction >> 12) & 0x0F);
+    if ((instruction >> 8) & 0x01) {
+        snprintf(buffer, size, "%s %s, %s, %s, bigimm", opcode_name(opcode), register_name(rd), register_name(rs), register_name(rt));
+    }
+    else {
+        snprintf(buffer, size, "%s %s, %s, %s, %d", opcode_name(opcode), register_name(rd), register_name(rs), register_name(rt), (int8_t)(instruction & 0xFF));
+    }
+}
+
+// Prints the fields of the first records that differ
+void print_difference(const TraceRecord* a, const TraceRecord* b, long long line) {
+    char text_a[96], text_b[96];
+
+    printf("First difference at line %lld\n", line);
+    if (!a->parsed || !b->parsed) {
+        printf("  a: %s\n  b: %s\n", a->text, b->text);
+        return;
+    }
+    if (a->cycle != b->cycle) {
+        printf("  cycle        a %08X  b %08X\n", a->cycle, b->cycle);
+    }
+    else {
+        printf("  cycle        %08X\n", a->cycle);
+    }
+    if (a->pc != b->pc) {
+        printf("  pc           a %03X  b %03X\n", a->pc, b->pc);
+    }
+    else {
+        printf("  pc           %03X\n", a->pc);
+    }
+    format_instruction(a->instruction, text_a, sizeof(text_a));
+    format_instruction(b->instruction, text_b, sizeof(text_b));
+    if (a->instruction != b->instruction) {
+        printf("  instruction  a %08X %s\n               b %08X %s\n", a->instruction, text_a, b->instruction, text_b);
+    }
+    else {
+        printf("  instruction  %08X %s\n", a->instruction, text_a);
+    }
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+        if (a->regs[r] != b->regs[r]) {
+            printf("  %-12s a %08X  b %08X  (%d, %d)\n", register_name(r), a->regs[r], b->regs[r], (int32_t)a->regs[r], (int32_t)b->regs[r]);
+        }
+    }
+}
+
+// Reads both files one record at a time from the line that starts after the chunk before first_chunk,
+// and prints the first records that differ with context records before and after them. Returns 1 if they differ, 2 on errors
+int compare_records(ChunkDiff* diff, long long first_chunk, int context) {
+    static TraceRecord before[MAX_CONTEXT];
+    TraceRecord records[2];
+    FILE* files[2] = { fopen(diff->filenames[0], "rb"), fopen(diff->filenames[1], "rb") };
+    long long start_chunk = first_chunk > 0 ? first_chunk - 1 : 0;
+    long long line = 1;
+    long long before_num = 0;
+    int result = 0;
+
+    if (!files[0] || !files[1]) {
+        printf("Error: Could not open the traces.\n");
+        if (files[0]) {
+            fclose(files[0]);
+        }
+        if (files[1]) {
+            fclose(files[1]);
+        }
+        return 2;
+    }
+    // The files are the same up to first_chunk, so both start at the same line, after the line that
+    // goes over the start of the chunk
+    for (long long i = 0; i < start_chunk; i++) {
+        line += diff->newlines[i];
+    }
+    if (start_chunk > 0) {
+        line++;
+    }
+    for (int f = 0; f < 2; f++) {
+        seek_file(files[f], start_chunk * diff->chunk_bytes, SEEK_SET);
+        if (start_chunk > 0) {
+            int c;
+            while ((c = fgetc(files[f])) != EOF && c != '\n') {}
+        }
+    }
+
+    for (;; line++) {
+        int has_a = read_record(files[0], &records[0]);
+        int has_b = read_record(files[1], &records[1]);
+        if (!has_a && !has_b) {
+            break;
+        }
+        if (has_a && has_b && same_record(&records[0], &records[1])) {
+            if (context > 0) {
+                before[before_num % context] = records[0];
+            }
+            before_num++;
+            continue;
+        }
+
+        // The first difference: the context before it, the records and the context after it
+        result = 1;
+        long long first = before_num > context ? before_num - context : 0;
+        for (long long i = first; i < before_num; i++) {
+            printf("  %lld: %s\n", line - (before_num - i), before[i % context].text);
+        }
+        if (has_a && has_b) {
+            printf("a %lld: %s\nb %lld: %s\n", line, records[0].text, line, records[1].text);
+            print_difference(&records[0], &records[1], line);
+        }
+        else {
+            printf("%c %lld: %s\n", has_a ? 'a' : 'b', line, has_a ? records[0].text : records[1].text);
+            printf("First difference at line %lld: %s ends before it\n", line, has_a ? "b" : "a");
+        }
+        for (int i = 1; i <= context; i++) {
+            int more_a = has_a && read_record(files[0], &records[0]);
+            int more_b = has_b && read_record(files[1], &records[1]);
+            if (!more_a && !more_b) {
+                break;
+            }
+            if (more_a) {
+                printf("a %lld: %s\n", line + i, records[0].text);
+            }
+            if (more_b) {
+                printf("b %lld: %s\n", line + i, records[1].text);
+            }
+            has_a = more_a;
+            has_b = more_b;
+        }
+        break;
+    }
+    fclose(files[0]);
+    fclose(files[1]);
+    return result;
+}
+
+// simtrace diff [-j threads] [-chunk KB] [-context N] <trace_a> <trace_b>
+int run_diff(int argc, char* argv[]) {
+    ChunkDiff diff;
+    int thread_num = 4;
+    int context = DEFAULT_CONTEXT;
+    long long chunk_kb = DEFAULT_CHUNK_KB;
+    int first = 2;
+
+    for (; first < argc && argv[first][0] == '-'; first++) {
+        if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+            thread_num = atoi(argv[++first]);
+        }
+        else if (strcmp(argv[first], "-chunk") == 0 && first + 1 < argc) {
+            chunk_kb = atoll(argv[++first]);
+        }
+        else if (strcmp(argv[first], "-context") == 0 && first + 1 < argc) {
+            context = atoi(argv[++first]);
+        }
+        else {
+            first = argc;
+        }
+    }
+    if (argc - first != 2 || thread_num < 1 || thread_num > MAX_THREADS || chunk_kb < 1 || context < 0 || context > MAX_CONTEXT) {
+        printf("Usage: %s diff [-j threads] [-chunk KB] [-context N] <trace_a> <trace_b>\n", argv[0]);
+        printf("  -j 1 to %d threads, 4 by default. -chunk KB of the compared chunks, %d by default. -context 0 to %d records, %d by default\n",
+            MAX_THREADS, DEFAULT_CHUNK_KB, MAX_CONTEXT, DEFAULT_CONTEXT);
+        return 2;
+    }
+
+    long long sizes[2] = { file_size(argv[first]), file_size(argv[first + 1]) };
+    for (int f = 0; f < 2; f++) {
+        if (sizes[f] < 0) {
+            printf("Error: Could not open trace file '%s'.\n", argv[first + f]);
+            return 2;
+        }
+    }
+
+    memset(&diff, 0, sizeof(ChunkDiff));
+    diff.filenames[0] = argv[first];
+    diff.filenames[1] = argv[first + 1];
+    diff.chunk_bytes = chunk_kb * 1024;
+    long long largest = sizes[0] > sizes[1] ? sizes[0] : sizes[1];
+    diff.chunk_num = (largest + diff.chunk_bytes - 1) / diff.chunk_bytes;
+    diff.first_diff = diff.chunk_num;
+    diff.newlines = calloc((size_t)diff.chunk_num + 1, sizeof(long long));
+    if (!diff.newlines || mtx_init(&diff.lock, mtx_plain) != thrd_success) {
+        printf("Error: Out of memory\n");
+        exit(1);
+    }
+
+    long long first_chunk = find_first_chunk(&diff, thread_num);
+    int result = 2;
+    if (first_chunk < 0) {
+        printf("Error: Could not read the traces.\n");
+    }
+    else if (first_chunk == diff.chunk_num) {
+        printf("The traces are the same\n");
+        result = 0;
+    }
+    else {
+        // A byte differs in first_chunk, the records may still be the same if only the -map comments differ
+        result = compare_records(&diff, first_chunk, context);
+        if (result == 0) {
+            printf("The traces have the same records\n");
+        }
+    }
+    mtx_destroy(&diff.lock);
+    free(diff.newlines);
+    return result;
+}